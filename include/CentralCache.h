@@ -1,50 +1,109 @@
 #pragma once
 /**
- * struct SpinLock      — 轻量自旋锁
- * 
+ * class AdaptiveLock   — 退避自旋 + futex 挂起的自适应锁，附带竞争统计
+ *
+ * struct BlockBatch     — 一次批量取块的结果：已回收区块链 + 新 span 中未切分的连续区间
+ *
  * class CentralCache   — 多线程共享的小对象中央缓存
  *  func:
- *      fetchBatch      — 为各 ThreadCache 批量提供 BlockHeader 链表
+ *      fetchBatch      — 为各 ThreadCache 批量提供区块（回收链优先，不足时从新 span 按需划出）
  *      returnBatch     — 当线程归还过多区块时，接收并缓存，在链表耗尽时向 PageCache 请求新的 span
+ *      reserve         — 预热：保证某个 size-class 至少备有 count 个区块，所需页预先缺页
+ *      reclaim         — 回收：请各线程收缩缓存，并把块已全部回到中央的 span 交还 PageCache
+ *      sweep           — 只做后一半：交还全空 span（线程收缩完成后调用）
+ *      lockStats       — 查询某个 size-class 的锁竞争统计
  */
 #include <array>
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <thread>
+#include <vector>
 
 #include "Common.h" // BlockHeader / kFreeListNum / kAlignment / kPageSize
 #include "PageCache.h"
 
-#ifdef __x86_64__
-#include <immintrin.h>
-#endif
-
 namespace mempool
 {
 
-struct SpinLock {
-    std::atomic_flag flag = ATOMIC_FLAG_INIT;
+/** 锁竞争统计快照 */
+struct LockStats {
+    std::uint64_t acquisitions{0}; // 总加锁次数
+    std::uint64_t contended{0};    // 首次 CAS 失败、需要等待的加锁次数
+    std::uint64_t spinCycles{0};   // 自旋阶段消耗的周期数（x86 为 TSC，其它平台为 ns）
+    std::uint64_t parks{0};        // 自旋无果、进入内核睡眠的次数
+};
+
+/**
+ * 自适应锁：先做有界指数退避自旋，仍拿不到则用 std::atomic::wait（futex）挂起。
+ * 锁持有者被抢占时，等待者不会把整个时间片烧在忙等上。
+ *
+ * state_: 0 = 空闲，1 = 已加锁，2 = 已加锁且可能有睡眠等待者
+ */
+class AdaptiveLock {
+public:
+    /* 退避上限：每轮 PAUSE 次数从 1 翻倍到 kMaxBackoff，之后挂起 */
+    static constexpr std::uint32_t kMaxBackoff = 64;
 
     void lock() noexcept {
-        while (flag.test_and_set(std::memory_order_acquire)) {
-#ifdef __x86_64__
-            /**
-             *  在这里插入 PAUSE 指令：
-                （1）在 Intel/AMD CPU 上，PAUSE 会告诉处理器“我正在做忙等”，
-                    有助于减少功耗并降低总线/缓存一致性流量。
-                （2）在超线程（SMT）环境下，它还能让出执行资源给同核的另一个硬线程，
-                    提高整体吞吐量、减少忙等对同核任务的干扰。
-                （3）它是单周期指令，开销远低于 yield 或 sleep_for。
-             */
-            _mm_pause();
-#else
-            // 非 x86-64 平台无法使用 PAUSE，直接继续忙等
-            ;
-#endif
+        std::uint32_t expected = 0;
+        if (state_.compare_exchange_strong(expected, 1, std::memory_order_acquire,
+                                           std::memory_order_relaxed)) {
+            bump(acquisitions_);
+            return;
         }
+        lockSlow();
     }
 
-    void unlock() noexcept { flag.clear(std::memory_order_release); }
+    /** 不等待：空闲时加锁并返回 true */
+    bool try_lock() noexcept {
+        std::uint32_t expected = 0;
+        if (!state_.compare_exchange_strong(expected, 1, std::memory_order_acquire,
+                                            std::memory_order_relaxed))
+            return false;
+        bump(acquisitions_);
+        return true;
+    }
+
+    void unlock() noexcept {
+        if (state_.exchange(0, std::memory_order_release) == 2) state_.notify_one();
+    }
+
+    /** 读取统计（无锁，数值可能略有滞后） */
+    LockStats stats() const noexcept {
+        return {acquisitions_.load(std::memory_order_relaxed),
+                contended_.load(std::memory_order_relaxed),
+                spinCycles_.load(std::memory_order_relaxed),
+                parks_.load(std::memory_order_relaxed)};
+    }
+
+private:
+    /* 竞争路径：退避自旋 → 挂起 */
+    void lockSlow() noexcept;
+
+    /* 计数只在持锁时写，单写者用 load+store 即可，避免 lock 前缀 */
+    static void bump(std::atomic<std::uint64_t>& c, std::uint64_t n = 1) noexcept {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    std::atomic<std::uint32_t> state_{0};
+
+    std::atomic<std::uint64_t> acquisitions_{0};
+    std::atomic<std::uint64_t> contended_{0};
+    std::atomic<std::uint64_t> spinCycles_{0};
+    std::atomic<std::uint64_t> parks_{0};
+};
+
+/**
+ * 批量取块结果。新 span 不再整段预先串链，而是以“未切分区间”的形式交出：
+ * 区间内的块只有在真正被分配时才写入头部，只有被释放过的块才会进入链表。
+ */
+struct BlockBatch {
+    BlockHeader* list{nullptr}; // 已回收区块链（头部完整）
+    std::size_t listCount{0};   // list 中的区块数
+    char* bumpBegin{nullptr};   // 未切分区间 [bumpBegin, bumpEnd)，长度为块大小的整数倍
+    char* bumpEnd{nullptr};
+    bool bumpZeroed{false};     // 未切分区间内容是否已知全零（span 刚来自 mmap / MADV_DONTNEED）
 };
 
 class CentralCache {
@@ -53,30 +112,90 @@ public:
     static CentralCache& getInstance();
 
     /**
-     * 从指定 size-class 取出 ≥ batchNum 个区块（等于或足够多即可）。
-     * 返回一条 BlockHeader* 单链，调用者拥有所有权。
+     * 从指定 size-class 取出至多 batchNum 个区块：先摘回收链，不足部分从当前 span 的
+     * 未切分区间划出（只移动指针，不触碰内存），区间耗尽且一块都没拿到时才补充新 span。
+     * 调用者拥有返回的全部区块；两部分都为空表示 PageCache 也失败。
      */
-    BlockHeader* fetchBatch(std::size_t index, std::size_t batchNum);
+    BlockBatch fetchBatch(std::size_t index, std::size_t batchNum);
 
     /** 将区块链（blockNum 个）归还给指定 size-class 的中央缓存 */
     void returnBatch(BlockHeader* start, std::size_t blockNum, std::size_t index);
 
+    /**
+     * 预热：让指定 size-class 的回收链 + 未切分区间至少容纳 count 个区块，返回实际可用块数。
+     * 新 span 以 populate 方式申请，现有未切分区间也预先缺页；一个 span 不够时，
+     * 旧区间的剩余块先切好挂入回收链，再换上新 span。
+     */
+    std::size_t reserve(std::size_t index, std::size_t count);
+
+    /**
+     * 回收：递增线程收缩纪元（各 ThreadCache 在下一次归还 / 补货时把本地缓存全部交回），
+     * 然后 sweep。可能在其它 size-class 锁被持有时调用（PageCache 补货路径），
+     * 因此只 try_lock，忙碌的类本轮跳过。
+     */
+    void reclaim();
+
+    /** 把区块已全部回到回收链 / 未切分区间的 span 交还 PageCache */
+    void sweep();
+
+    /** 线程收缩纪元：与 ThreadCache 记录的值不同即需收缩 */
+    static std::uint64_t trimEpoch() noexcept { return trimEpoch_.load(std::memory_order_relaxed); }
+
+    /** 指定 size-class 的锁竞争统计，用于定位热点类 */
+    LockStats lockStats(std::size_t index) const noexcept { return locks_[index].stats(); }
+
 private:
-    CentralCache();
+    friend class Heap; // 独立堆各自持有一个 CentralCache
+
+    explicit CentralCache(PageCache& pageCache);
     ~CentralCache() = default;
 
     CentralCache(const CentralCache&) = delete;
     CentralCache& operator=(const CentralCache&) = delete;
 
-    /* 向 PageCache 申请 span 并切分为 BlockHeader 链 */
-    void refillFromPageCache(std::size_t index);
+    /* 着色步长：切块起点按缓存行错开 */
+    static constexpr std::size_t kColorAlign = 64;
+
+    /* 向 PageCache 申请 span，（着色偏移后的）整段作为新的未切分区间；失败返回 false */
+    bool refillFromPageCache(std::size_t index, bool populate = false);
+
+    /* 把未切分区间剩余的块全部写好头部挂入回收链（持锁调用） */
+    void spillBumpToList(std::size_t index);
+
+    /* 交还该 size-class 中全空的 span，返回交还的页数（持锁调用） */
+    std::size_t releaseFreeSpans(std::size_t index);
+
+    /* PageCache 回收器入口 */
+    static void reclaimThunk(void* self) { static_cast<CentralCache*>(self)->reclaim(); }
+
+    /** 本类从 PageCache 领到的一个 span */
+    struct SpanRecord {
+        char* base;
+        std::size_t pages;
+    };
 
 private:
+    /* span 的来源：默认实例用全局 PageCache，独立堆用自己的 */
+    PageCache& pageCache_;
+
     /* 各 size-class 的空闲链表头 */
     std::array<std::atomic<BlockHeader*>, kFreeListNum> centralFreeList_{};
 
-    /* 对应的自旋锁 */
-    std::array<SpinLock, kFreeListNum> locks_{};
+    /* 各 size-class 当前 span 的未切分区间 [bumpCur_, bumpEnd_)（持锁访问） */
+    std::array<char*, kFreeListNum> bumpCur_{};
+    std::array<char*, kFreeListNum> bumpEnd_{};
+    std::array<bool, kFreeListNum> bumpZeroed_{};
+
+    /* 各 size-class 下一个 span 的着色序号（持锁访问），见 refillFromPageCache */
+    std::array<std::uint16_t, kFreeListNum> color_{};
+
+    /* 各 size-class 持有的 span（持锁访问），回收时据此判断哪些 span 已全空 */
+    std::array<std::vector<SpanRecord>, kFreeListNum> spans_{};
+
+    /* 对应的自适应锁 */
+    std::array<AdaptiveLock, kFreeListNum> locks_{};
+
+    static inline std::atomic<std::uint64_t> trimEpoch_{0};
 };
 
 } // namespace mempool
@@ -40,6 +40,14 @@ struct SizeClass {
     static inline std::size_t getIndex(std::size_t bytes) noexcept {
         return (roundUp(bytes) / kAlignment) - 1;
     }
+
+    /** 下标对应的 user 字节数 */
+    static inline std::size_t userBytes(std::size_t index) noexcept { return (index + 1) * kAlignment; }
+
+    /** 下标对应的块总字节数（含头部） */
+    static inline std::size_t blockBytes(std::size_t index) noexcept {
+        return userBytes(index) + sizeof(BlockHeader);
+    }
 };
 
 } // namespace mempool
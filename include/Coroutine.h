@@ -0,0 +1,112 @@
+#pragma once
+/**
+ * 协程帧分配（C++20 协程）
+ *
+ * struct pooled_promise — promise_type 的基类：协程帧的 operator new / delete 交给 FrameCache
+ *      struct promise_type : mempool::pooled_promise { ... };
+ *
+ * class FrameCache      — 每线程按帧大小回收协程帧
+ *  func:
+ *      allocate(size)        — 命中同尺寸的回收帧直接取走，否则 MemoryPool::allocate
+ *      deallocate(ptr, size) — 按尺寸挂回本线程缓存，槽位满或尺寸冲突时 MemoryPool::deallocate(ptr, size)
+ *
+ * 同一个协程函数的帧大小由编译器确定且固定，sized operator delete 把它原样交回，
+ * 因此按“精确帧大小”直接映射到 kSlots 个槽位，命中时不查 size-class、不读块头。
+ * 帧仍是 MemoryPool 的块（带 BlockHeader），可以在任何线程释放：
+ * 其它线程的 FrameCache 会收下它，槽位满时再经 MemoryPool 归还。
+ * 本线程缓存析构之后（更晚的 TLS 析构函数中）创建 / 销毁的帧直接经 MemoryPool 分配 / 归还。
+ *
+ * 缓存中的帧对 Trace / Tags 而言仍处于已分配状态：复用时不再记录分配事件，
+ * 也沿用首次分配时的标签。
+ */
+#include <array>
+#include <cstddef>
+#include <new> // std::bad_alloc
+
+#include "MemoryPool.h"
+
+namespace mempool
+{
+
+class FrameCache {
+public:
+    /* 槽位数（按帧大小 / kAlignment 取模直接映射）与每槽最多缓存的帧数 */
+    static constexpr std::size_t kSlots = 16;
+    static constexpr std::size_t kMaxFramesPerSlot = 64;
+
+    /** 分配 size 字节的协程帧；失败抛出 std::bad_alloc */
+    static void* allocate(std::size_t size) {
+        if (FrameCache* fc = instance()) [[likely]] {
+            Slot& s = fc->slots_[slotOf(size)];
+            if (s.size == size && s.head) [[likely]] {
+                void* p = s.head;
+                s.head = *static_cast<void**>(p);
+                --s.count;
+                return p;
+            }
+        }
+        void* p = MemoryPool::allocate(size);
+        if (!p) throw std::bad_alloc();
+        return p;
+    }
+
+    /** 归还协程帧；size 须与分配时一致（sized delete 保证） */
+    static void deallocate(void* ptr, std::size_t size) noexcept {
+        if (FrameCache* fc = instance()) [[likely]] {
+            Slot& s = fc->slots_[slotOf(size)];
+            if (s.size != size && s.count == 0) s.size = size; // 空槽位改挂新尺寸
+            if (s.size == size && s.count < kMaxFramesPerSlot) [[likely]] {
+                *static_cast<void**>(ptr) = s.head;
+                s.head = ptr;
+                ++s.count;
+                return;
+            }
+        }
+        MemoryPool::deallocate(ptr, size);
+    }
+
+private:
+    /** 一个槽位：某个帧大小的回收链（经帧内存的前 8 字节串联） */
+    struct Slot {
+        std::size_t size{0};
+        void* head{nullptr};
+        std::size_t count{0};
+    };
+
+    FrameCache() = default;
+    ~FrameCache(); // 线程退出时把缓存的帧交还 MemoryPool
+
+    FrameCache(const FrameCache&) = delete;
+    FrameCache& operator=(const FrameCache&) = delete;
+
+    static std::size_t slotOf(std::size_t size) noexcept { return (size / kAlignment) % kSlots; }
+
+    /** 本线程缓存；已析构时返回 nullptr */
+    static FrameCache* instance() {
+        if (FrameCache* fc = tls_) [[likely]]
+            return fc;
+        return initSlow();
+    }
+
+    /**
+     * 线程首次使用：先确保本线程 ThreadCache 已构造（从而晚于本缓存析构），再构造本缓存；
+     * 本缓存或 ThreadCache 已析构时返回 nullptr，不再触碰已销毁的 thread_local
+     */
+    static FrameCache* initSlow();
+
+    std::array<Slot, kSlots> slots_{};
+
+    static inline thread_local FrameCache* tls_ MEMPOOL_TLS_MODEL = nullptr;
+    static inline thread_local bool destroyed_ MEMPOOL_TLS_MODEL = false;
+};
+
+/**
+ * 协程 promise_type 的基类：帧经 FrameCache 从内存池分配。
+ * 只提供类内 operator new / delete，不影响 promise 的其它成员。
+ */
+struct pooled_promise {
+    static void* operator new(std::size_t size) { return FrameCache::allocate(size); }
+    static void operator delete(void* ptr, std::size_t size) noexcept { FrameCache::deallocate(ptr, size); }
+};
+
+} // namespace mempool
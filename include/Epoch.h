@@ -0,0 +1,64 @@
+#pragma once
+/**
+ * class Epoch — 基于纪元的延迟回收（EBR），供 MemoryPool::retire / EpochGuard 使用
+ *  func:
+ *      global()       — 当前全局纪元
+ *      acquire()      — 为当前线程取一条登记记录（复用已退出线程的记录）
+ *      release(rec)   — 线程退出时归还记录
+ *      tryAdvance()   — 所有处于临界区的线程都已见到当前纪元时，全局纪元推进一格
+ *      orphan(...)    — 线程退出时尚未到期的退休块交给全局孤儿表
+ *      adoptOrphans() — 取走已到期的孤儿块，由调用线程释放
+ *
+ * 规则：读者在 EpochGuard 内访问共享结构，进入时把当时的全局纪元写入自己的记录；
+ * 全局纪元只有在所有处于临界区的记录都等于它时才能前进。一个块在全局纪元为 e 时退休，
+ * 等到全局纪元 >= e + 2，退休前进入临界区的读者必然都已离开，可以安全回收。
+ *
+ * 退休块通过 BlockHeader::next 串链（对象交出后该字段闲置），不额外分配内存。
+ * 登记记录只增不删，线程退出后留给新线程复用。
+ */
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "Common.h" // BlockHeader
+
+namespace mempool
+{
+
+/** 每线程一条的纪元登记记录 */
+struct EpochRecord {
+    std::atomic<std::uint64_t> pinned{0}; // 0 = 不在临界区，否则为进入临界区时的全局纪元
+    std::atomic<bool> inUse{false};       // 是否已被某个线程占用
+    EpochRecord* next{nullptr};           // 登记表中的后继（发布后不再修改）
+};
+
+class Epoch {
+public:
+    /** 退休块到期所需的纪元间隔 */
+    static constexpr std::uint64_t kGracePeriods = 2;
+
+    /** 当前全局纪元（从 1 开始，0 保留给“不在临界区”） */
+    static std::uint64_t global() noexcept { return global_.load(std::memory_order_acquire); }
+
+    /** 为当前线程取一条登记记录 */
+    static EpochRecord* acquire();
+
+    /** 归还登记记录（调用者须已离开临界区） */
+    static void release(EpochRecord* rec) noexcept;
+
+    /** 尝试把全局纪元推进一格；有线程停留在旧纪元时返回 false */
+    static bool tryAdvance() noexcept;
+
+    /** 线程退出时把尚未到期的退休链（在纪元 epoch 退休）交给孤儿表 */
+    static void orphan(BlockHeader* head, std::uint64_t epoch);
+
+    /** 取走所有已到期的孤儿块，串成一条链返回；无到期块或他人正在处理时返回 nullptr */
+    static BlockHeader* adoptOrphans();
+
+private:
+    static inline std::atomic<std::uint64_t> global_{1};
+    static inline std::atomic<EpochRecord*> records_{nullptr};
+    static inline std::atomic<bool> hasOrphans_{false};
+};
+
+} // namespace mempool
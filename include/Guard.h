@@ -0,0 +1,91 @@
+#pragma once
+/**
+ * class Guard — 采样守护页（GWP-ASan 式的生产环境越界 / 释放后使用检测）
+ *  func:
+ *      nextInterval()   — 下一次采样前的分配次数（每线程倒数，ThreadCache 调用）
+ *      allocate(size)   — 在独立的守护槽位上分配：块右端紧贴 PROT_NONE 守护页
+ *      deallocate(ptr)  — 归还守护块：整页改为 PROT_NONE 并进入隔离队列
+ *      owns(ptr)        — ptr 是否位于守护槽位区
+ *      stats()          — 采样 / 存活 / 槽位用尽的计数
+ *
+ * guard.sample_rate = N（0 为关闭）时，每个线程大约每 N 次 ThreadCache::allocate 取一次样
+ * （间隔在 [1, 2N-1] 内随机，避免固定步长与调用模式同步）。快速路径上只有一次计数器递减与判断；
+ * 关闭时计数器每 kDisabledInterval 次分配进入慢路径一次，以便运行中打开采样。
+ * 独立堆（Heap）的线程缓存不参与采样。
+ *
+ * 槽位区在首次采样时一次性预留 guard.slots 个槽位，每个槽位为“数据页 + 守护页”，
+ * 未使用时整段 PROT_NONE。用户块按 kAlignment 取整后右对齐到数据页末尾，
+ * 越过块尾（向上取整的尾部除外）的第一次访问就落在守护页上；块头 BlockHeader 仍在块前，
+ * size 带 kGuardedFlag，释放时落入 ThreadCache::deallocate 原有的大对象慢分支。
+ *
+ * 释放后数据页改回 PROT_NONE 并 MADV_DONTNEED，槽位排到空闲队列尾部：
+ * 空闲槽位按 FIFO 复用，刚释放的槽位最晚被复用（隔离），期间的任何访问都会触发故障。
+ * 重复释放 / 释放非块首指针在 deallocate 中直接报告并 abort。
+ *
+ * 故障报告：槽位区建立时安装 SIGSEGV 处理器（链接到之前的处理器）。
+ * 落在槽位区的故障输出故障类型、相对块的偏移、分配与释放时的线程号与调用栈（backtrace），
+ * 然后恢复之前的处理方式并返回，由重新执行的访问按原处理方式终止进程（默认 core dump）。
+ * 调用栈的符号名需要以 -rdynamic 链接，否则只输出模块与偏移。
+ *
+ * 只接收 size + sizeof(BlockHeader) 不超过一页的请求；更大的请求、槽位用尽时照常从缓存分配。
+ * 守护槽位不计入 limit.* 上限。
+ */
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "Common.h" // BlockHeader / kPageSize
+
+namespace mempool
+{
+
+/** 守护页计数 */
+struct GuardStats {
+    std::uint64_t sampled{0};   // 累计在守护槽位上分配的块数
+    std::uint64_t live{0};      // 当前存活的守护块数
+    std::uint64_t exhausted{0}; // 采样命中但槽位用尽、退回普通分配的次数
+    std::size_t slots{0};       // 槽位总数（尚未建立槽位区时为 0）
+};
+
+class Guard {
+public:
+    /** BlockHeader::size 中标记守护块的位（标签占用其上的 56..63 位，见 Tags.h） */
+    static constexpr std::uint64_t kGuardedFlag = std::uint64_t{1} << 55;
+
+    /** 采样关闭时，计数器倒数这么多次才检查一次开关 */
+    static constexpr std::uint32_t kDisabledInterval = 1u << 16;
+
+    /** 每个分配 / 释放调用栈最多记录的帧数 */
+    static constexpr int kMaxFrames = 32;
+
+    /** 守护槽位能容纳的最大用户字节数 */
+    static constexpr std::size_t kMaxGuardedBytes = kPageSize - sizeof(BlockHeader);
+
+    /** 下一次采样前的分配次数：按 guard.sample_rate 随机取值，关闭时为 kDisabledInterval */
+    static std::uint32_t nextInterval() noexcept;
+
+    /** 在守护槽位上分配 size 字节；采样关闭、size 放不进一页或槽位用尽时返回 nullptr */
+    static void* allocate(std::size_t size) noexcept;
+
+    /** 归还守护块；ptr 不是存活守护块的块首时报告并 abort */
+    static void deallocate(void* ptr) noexcept;
+
+    /** ptr 是否位于守护槽位区（含已释放的槽位） */
+    static bool owns(const void* ptr) noexcept {
+        auto a = reinterpret_cast<std::uintptr_t>(ptr);
+        return a >= begin_.load(std::memory_order_relaxed) && a < end_.load(std::memory_order_relaxed);
+    }
+
+    /** 当前计数 */
+    static GuardStats stats();
+
+private:
+    /** 首次采样时预留槽位区并安装故障处理器（调用者持有槽位锁）；失败返回 false */
+    static bool initRegion() noexcept;
+
+    /* 槽位区 [begin_, end_)，建立后不再改变（进程生命周期内不解除映射） */
+    static inline std::atomic<std::uintptr_t> begin_{0};
+    static inline std::atomic<std::uintptr_t> end_{0};
+};
+
+} // namespace mempool
@@ -0,0 +1,83 @@
+#pragma once
+/**
+ * class Heap — 独立的内存堆实例
+ *  func:
+ *      allocate(size)   — 从本堆分配
+ *      deallocate(ptr)  — 归还本堆分配的内存（不得混用其它堆 / MemoryPool 的指针）
+ *      owns(ptr)        — ptr 是否来自本堆
+ *      systemPages()    — 本堆当前向系统持有的页数
+ *      freePages()      — 本堆 PageCache 中的空闲页数
+ *
+ * 每个堆拥有自己的 PageCache、CentralCache 与每线程 ThreadCache，不同堆之间互不共享页，
+ * 一个租户 / 子系统的突发分配不会把碎片留给其它堆。MemoryPool 仍是默认堆（全局单例）。
+ *
+ * 大于 kMaxBytes 的对象直接从本堆 PageCache 按页申请（而不是 malloc），同样随堆销毁。
+ *
+ * 销毁：析构时把本堆向系统申请的地址区间整段 munmap，只遍历 span，不遍历对象；
+ * 之后本堆分配的所有指针立即失效。各线程中属于本堆的 ThreadCache 不逐个清理，
+ * 而是在槽位被新堆复用时、或线程退出时丢弃（靠堆编号识别过期缓存）。
+ * 线程退出时本堆仍存活，则该线程的缓存先交还本堆的 CentralCache。
+ * 析构与本堆的 allocate / deallocate 不得并发。
+ */
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "CentralCache.h"
+#include "PageCache.h"
+#include "ThreadCache.h"
+
+namespace mempool
+{
+
+class Heap {
+public:
+    /* 同时存在的独立堆上限（每线程为每个槽位保存一个 ThreadCache 指针） */
+    static constexpr std::size_t kMaxHeaps = 64;
+
+    /** 创建独立堆；已有 kMaxHeaps 个堆存活时抛出 std::bad_alloc */
+    Heap();
+
+    /** 销毁：整体归还本堆的全部页 */
+    ~Heap();
+
+    Heap(const Heap&) = delete;
+    Heap& operator=(const Heap&) = delete;
+
+    /** 分配 size 字节 */
+    void* allocate(std::size_t size);
+
+    /** 归还本堆分配的内存 */
+    void deallocate(void* ptr);
+
+    /** ptr 是否位于本堆的页内 */
+    bool owns(const void* ptr) const noexcept;
+
+    /** 本堆当前向系统持有的总页数 */
+    std::size_t systemPages() const noexcept { return pageCache_->systemPages(); }
+
+    /** 本堆 PageCache 中的空闲页数 */
+    std::size_t freePages() const noexcept { return pageCache_->freePages(); }
+
+private:
+    /** 当前线程在本堆的 ThreadCache；首次使用或槽位上是过期缓存时新建 */
+    ThreadCache& localCache();
+
+    /** 每线程：槽位 → (堆编号, ThreadCache)；线程退出时释放 */
+    struct LocalCaches {
+        struct Entry {
+            std::uint64_t heapId{0};
+            ThreadCache* cache{nullptr};
+        };
+        std::array<Entry, kMaxHeaps> slots{};
+        ~LocalCaches();
+    };
+    static thread_local LocalCaches localCaches_;
+
+    PageCache* pageCache_;
+    CentralCache* central_;
+    std::size_t slot_;  // 本堆占用的槽位
+    std::uint64_t id_;  // 全局唯一编号，用于识别过期的线程缓存
+};
+
+} // namespace mempool
@@ -2,21 +2,217 @@
 /**
  * class MemoryPool
  *  func:
- *      void*  allocate(std::size_t size);   — 分配内存
- *      void   deallocate(void* ptr);        — 回收内存
+ *      void*  allocate(std::size_t size);                 — 分配内存
+ *      void*  allocate(std::size_t size, Tags::Tag tag);  — 分配并打上子系统标签（见 Tags.h）
+ *      class  TagScope;                                   — 作用域内的 allocate 自动带上标签
+ *      TagStats tagStats(tag) / setTagBudget(tag, bytes)  — 按标签汇总计数 / 软预算
+ *      void*  allocate_zeroed(std::size_t size);          — 分配并清零（已知全零的新页跳过 memset）
+ *      void*  calloc(std::size_t n, std::size_t size);    — calloc 语义：n 个 size 字节的全零对象
+ *      void   deallocate(void* ptr);                      — 回收内存
+ *      void   deallocate(void* ptr, std::size_t size);    — 按大小回收（sized delete），调试构建中与块头核对
+ *      void   retire(void* ptr);                          — 延迟回收：等所有读者离开后才真正回收
+ *      size_t collectRetired();                           — 尽力回收本线程已到期的退休块
+ *      class  EpochGuard;                                 — 读临界区（RAII），期间读到的对象不会被回收
+ *      bool   reserve(size, count, fillThreadCache);      — 预热单个 size-class：预先切好并缺页 count 块
+ *      bool   prewarm(const PrewarmProfile& profile);     — 按配置预热多个 size-class
+ *      bool   setOption(name, value) / getOption(name, value) — 运行期参数（见 Options.h）
+ *      void   releaseMemory();                            — 立即回收：收缩线程缓存、交还空 span、归还系统
+ *      OomHandler setOomHandler(OomHandler handler);      — 硬上限下回收仍失败时的回调
+ *      bool   startTrace(const char* path);               — 开始记录分配轨迹（见 Trace.h）
+ *      void   stopTrace();                                — 停止记录
  */
+#include <cassert>
+#include <new> // std::bad_alloc
+#include <vector>
+
+#include "Options.h"
+#include "Tags.h"
 #include "ThreadCache.h"
+#include "Trace.h"
 
 namespace mempool
 {
 
+/** 预热配置：各 size-class 预备的块数，以及是否同时填充调用线程的 ThreadCache */
+struct PrewarmProfile {
+    struct Entry {
+        std::size_t size;  // 对象大小（字节）
+        std::size_t count; // 预备块数
+    };
+    std::vector<Entry> classes;
+    bool fillThreadCache{false};
+};
+
 class MemoryPool {
 public:
     /**  分配 size 字节的对象 */
-    static void* allocate(std::size_t size) { return ThreadCache::getInstance().allocate(size); }
+    static void* allocate(std::size_t size) {
+        ThreadCache* tc = ThreadCache::current();
+        void* p = tc ? tc->allocate(size) : ThreadCache::allocateDirect(size);
+        if (Tags::enabled()) [[unlikely]] Tags::attachCurrent(p);
+        if (Trace::enabled()) [[unlikely]] Trace::recordAlloc(p, size);
+        return p;
+    }
+
+    /** 分配并记入标签 tag（1..255；0 等同于不带标签） */
+    static void* allocate(std::size_t size, Tags::Tag tag) {
+        ThreadCache* tc = ThreadCache::current();
+        void* p = tc ? tc->allocate(size) : ThreadCache::allocateDirect(size);
+        Tags::attach(p, tag);
+        if (Trace::enabled()) [[unlikely]] Trace::recordAlloc(p, size);
+        return p;
+    }
+
+    /**
+     * 标签作用域：存活期间本线程的 allocate / allocate_zeroed 都记入 tag，可嵌套，析构时恢复外层标签。
+     * 从未使用过标签时，分配路径上只多一次全局开关检查，释放路径完全不变。
+     */
+    class TagScope {
+    public:
+        explicit TagScope(Tags::Tag tag) : prev_(Tags::current()) { Tags::setCurrent(tag); }
+        ~TagScope() { Tags::setCurrent(prev_); }
+
+        TagScope(const TagScope&) = delete;
+        TagScope& operator=(const TagScope&) = delete;
+
+    private:
+        Tags::Tag prev_;
+    };
+
+    /** 汇总所有线程中标签 tag 的存活字节 / 累计分配 / 释放；分配速率取两次快照之差 */
+    static TagStats tagStats(Tags::Tag tag) { return Tags::stats(tag); }
+
+    /** 标签软预算（0 为不限）：存活字节越线时调用 setTagBudgetHandler 注册的回调，不拒绝分配 */
+    static void setTagBudget(Tags::Tag tag, std::size_t bytes) { Tags::setBudget(tag, bytes); }
+    static Tags::BudgetHandler setTagBudgetHandler(Tags::BudgetHandler handler) {
+        return Tags::setBudgetHandler(handler);
+    }
+
+    /** 分配 size 字节并保证内容全零 */
+    static void* allocate_zeroed(std::size_t size) {
+        ThreadCache* tc = ThreadCache::current();
+        void* p = tc ? tc->allocateZeroed(size) : ThreadCache::allocateDirect(size, true);
+        if (Tags::enabled()) [[unlikely]] Tags::attachCurrent(p);
+        if (Trace::enabled()) [[unlikely]] Trace::recordAlloc(p, size);
+        return p;
+    }
+
+    /** calloc 语义；n * size 溢出时抛出 std::bad_alloc */
+    static void* calloc(std::size_t n, std::size_t size) {
+        std::size_t bytes;
+        if (__builtin_mul_overflow(n, size, &bytes)) throw std::bad_alloc();
+        return allocate_zeroed(bytes);
+    }
 
     /** 归还内存（自动根据 BlockHeader 解析大小）*/
-    static void deallocate(void* ptr) { ThreadCache::getInstance().deallocate(ptr); }
+    static void deallocate(void* ptr) {
+        if (Trace::enabled()) [[unlikely]] Trace::recordFree(ptr);
+        if (ThreadCache* tc = ThreadCache::current()) [[likely]]
+            tc->deallocate(ptr);
+        else
+            ThreadCache::deallocateDirect(ptr);
+    }
+
+    /** 按大小归还：size 须不超过分配时请求的大小；块头仍是依据（标签 / 守护标记），size 只用于核对 */
+    static void deallocate(void* ptr, std::size_t size) {
+        assert((!ptr || size <= Tags::sizeOf(reinterpret_cast<BlockHeader*>(ptr)[-1].size)) &&
+               "sized free larger than the block");
+        (void)size;
+        deallocate(ptr);
+    }
+
+    /**
+     * 延迟回收，供无锁数据结构使用：ptr 已从共享结构中摘除，但其它线程可能仍持有它。
+     * 等所有在此之前进入 EpochGuard 的线程都离开后，ptr 才回到本线程空闲链。
+     * 读者始终在 EpochGuard 内访问共享结构；长期停留在临界区会推迟所有线程的回收。
+     */
+    static void retire(void* ptr) {
+        if (Trace::enabled()) [[unlikely]] Trace::recordFree(ptr);
+        if (ThreadCache* tc = ThreadCache::current()) [[likely]]
+            tc->retire(ptr);
+        else
+            ThreadCache::retireOrphan(ptr);
+    }
+
+    /** 尽力推进纪元并回收本线程已到期的退休块，返回仍在等待的块数（线程退出阶段恒为 0） */
+    static std::size_t collectRetired() {
+        ThreadCache* tc = ThreadCache::current();
+        return tc ? tc->collectRetired() : 0;
+    }
+
+    /**
+     * 读临界区：构造时登记当前全局纪元，析构时撤销，可嵌套。
+     * 开销为一次 TLS 读取与一次全屏障，不加锁、不分配。
+     * 本线程的 ThreadCache 析构之后（更晚的 TLS 析构函数中）为空操作：纪元记录已归还，
+     * 此时 retire 的块直接进入孤儿表。
+     *
+     *     MemoryPool::EpochGuard g;
+     *     Node* n = head.load(std::memory_order_acquire); // g 存活期间 n 不会被回收
+     */
+    class EpochGuard {
+    public:
+        EpochGuard() : tc_(ThreadCache::current()) {
+            if (tc_) tc_->pin();
+        }
+        ~EpochGuard() {
+            if (tc_) tc_->unpin();
+        }
+
+        EpochGuard(const EpochGuard&) = delete;
+        EpochGuard& operator=(const EpochGuard&) = delete;
+
+    private:
+        ThreadCache* tc_;
+    };
+
+    /**
+     * 预热：让 size 所在 size-class 在 CentralCache 中备好 count 个已缺页的区块，
+     * 首次请求不再经历 refill → mmap → 缺页。fillThreadCache 时再把其中一部分搬进
+     * 调用线程的 ThreadCache（受本地链上限约束）。size > kMaxBytes 走 malloc，返回 false。
+     */
+    static bool reserve(std::size_t size, std::size_t count, bool fillThreadCache = false) {
+        if (size == 0) size = kAlignment;
+        if (size > kMaxBytes) return false;
+        bool ok = CentralCache::getInstance().reserve(SizeClass::getIndex(size), count) >= count;
+        if (fillThreadCache)
+            if (ThreadCache* tc = ThreadCache::current()) tc->reserve(size, count);
+        return ok;
+    }
+
+    /** 按配置逐项 reserve；全部达到预备块数时返回 true */
+    static bool prewarm(const PrewarmProfile& profile) {
+        bool ok = true;
+        for (const auto& e : profile.classes)
+            ok = reserve(e.size, e.count, profile.fillThreadCache) && ok;
+        return ok;
+    }
+
+    /** 修改运行期参数，例如 setOption("tcache.max_bytes", 8 << 20)；也可用环境变量 MEMPOOL_OPTIONS */
+    static bool setOption(const char* name, std::size_t value) { return Options::set(name, value); }
+
+    /** 读取运行期参数当前值 */
+    static bool getOption(const char* name, std::size_t& value) { return Options::get(name, value); }
+
+    /**
+     * 立即回收：本线程缓存交回中央，请其它线程在下一次归还 / 补货时同样收缩，
+     * 全空的 span 交还 PageCache，完整空闲的系统块 munmap，其余空闲页 MADV_DONTNEED。
+     */
+    static void releaseMemory() {
+        if (ThreadCache* tc = ThreadCache::current()) tc->flush();
+        PageCache::getInstance().reclaim();
+    }
+
+    /**
+     * 注册 OOM 处理器（limit.hard_bytes 超限或 mmap 失败、且回收后仍不够时调用）。
+     * 处理器返回 true 表示已腾出内存、重试申请；返回 false 则 allocate 抛出 std::bad_alloc。
+     */
+    static OomHandler setOomHandler(OomHandler handler) { return PageCache::setOomHandler(handler); }
+
+    /** 开始把分配 / 回收事件记录到 path；也可用环境变量 MEMPOOL_TRACE 开启 */
+    static bool startTrace(const char* path) { return Trace::start(path); }
+
+    /** 停止记录并刷出所有线程缓冲 */
+    static void stopTrace() { Trace::stop(); }
 };
 
-} // namespace mempool
\ No newline at end of file
+} // namespace mempool
@@ -0,0 +1,97 @@
+#pragma once
+/**
+ * class Options — 运行期可调参数（mallctl 风格，按名字读写）
+ *  func:
+ *      set(name, value)   — 修改参数；名字未知或取值非法返回 false
+ *      get(name, value)   — 读取参数当前值；名字未知返回 false
+ *      parse(spec)        — 解析 "name=value,name=value" 字符串，返回成功应用的条数
+ *
+ * 启动时自动解析环境变量 MEMPOOL_OPTIONS，例如：
+ *      MEMPOOL_OPTIONS="tcache.max_bytes=8388608,tcache.batch.64=1024,page.release_threshold=32768"
+ *
+ * 参数一览（括号内为默认值）：
+ *      tcache.max_bytes            每线程空闲链缓存的字节预算，0 为不限（0）
+ *      tcache.list_factor          单个 size-class 本地链上限 = batch * list_factor（16）
+ *      tcache.batch.<bytes>        <bytes> 所在 size-class 一次从 CentralCache 取的块数，0 为按大小自动（0）
+ *      central.span_pages          CentralCache 每次申请 span 的最少页数（8）
+ *      central.min_blocks_per_span 每个 span 至少容纳的块数（4）
+ *      central.coloring            span 着色：切块起点在尾部余量内按缓存行轮转，0 为关闭（1）
+ *      page.release_threshold      PageCache 空闲页超过此值时归还系统，各分片均摊（16384）
+ *      limit.soft_bytes            软上限：向系统映射的字节超过此值时主动回收，0 为不限（0）
+ *      limit.hard_bytes            硬上限：申请新页不得超过此值，先回收再调用 OOM 处理器，0 为不限（0）
+ *      guard.sample_rate           守护页采样：每线程约每 N 次分配放一块到守护页上，0 为关闭（0）
+ *      guard.slots                 守护槽位数，首次采样时按此值预留（256）
+ *
+ * 所有参数都是 relaxed 原子量，分配路径上直接读取，运行中修改是安全的：
+ * 新值在下一次补货 / 申请 span 时生效，已有的 span 不受影响。
+ * ThreadCache 在快速路径上缓存 tcache.* 与批量派生的上限；每次成功的 set 递增参数代数，
+ * 各线程在下一次 deallocate 时发现代数变化并重新读取，已经缓存的块按新上限归还。
+ */
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "Common.h" // kFreeListNum
+
+namespace mempool
+{
+
+class Options {
+public:
+    /** 修改参数；名字未知或取值越界返回 false */
+    static bool set(const char* name, std::size_t value) noexcept;
+
+    /** 读取参数；名字未知返回 false */
+    static bool get(const char* name, std::size_t& value) noexcept;
+
+    /** 解析逗号分隔的 name=value 列表，返回成功应用的条数 */
+    static std::size_t parse(const char* spec) noexcept;
+
+    /* ---------- 分配路径上的快速读取 ---------- */
+    static std::size_t tcacheMaxBytes() noexcept { return tcacheMaxBytes_.load(std::memory_order_relaxed); }
+    static std::size_t tcacheListFactor() noexcept { return tcacheListFactor_.load(std::memory_order_relaxed); }
+    static std::size_t batchOverride(std::size_t index) noexcept {
+        return batch_[index].load(std::memory_order_relaxed);
+    }
+    static std::size_t spanPages() noexcept { return spanPages_.load(std::memory_order_relaxed); }
+    static std::size_t minBlocksPerSpan() noexcept { return minBlocksPerSpan_.load(std::memory_order_relaxed); }
+    static bool coloring() noexcept { return coloring_.load(std::memory_order_relaxed) != 0; }
+    static std::size_t releaseThresholdPages() noexcept {
+        return releaseThresholdPages_.load(std::memory_order_relaxed);
+    }
+    static std::size_t softLimitBytes() noexcept { return softLimitBytes_.load(std::memory_order_relaxed); }
+    static std::size_t hardLimitBytes() noexcept { return hardLimitBytes_.load(std::memory_order_relaxed); }
+    static std::size_t guardSampleRate() noexcept { return guardSampleRate_.load(std::memory_order_relaxed); }
+    static std::size_t guardSlots() noexcept { return guardSlots_.load(std::memory_order_relaxed); }
+
+    /** 参数代数：每次成功的 set 递增，供缓存了上限的线程发现变化 */
+    static std::uint64_t generation() noexcept { return generation_.load(std::memory_order_acquire); }
+
+    /* 取值上限：防止一次补货 / 一个 span 大到失去意义 */
+    static constexpr std::size_t kMaxBatch = 65535;
+    static constexpr std::size_t kMaxSpanPages = 64 * 1024; // 256 MB
+    static constexpr std::size_t kMaxGuardSampleRate = std::size_t{1} << 30;
+    static constexpr std::size_t kMaxGuardSlots = 64 * 1024; // 512 MB 地址空间
+
+    /* page.release_threshold 的默认值：PageCache 空闲页超过此值时归还系统，由各分片均摊 */
+    static constexpr std::size_t kDefaultReleaseThresholdPages = 16 * 1024; // 64 MB (4 K 页)
+
+private:
+    static inline std::atomic<std::size_t> tcacheMaxBytes_{0};
+    static inline std::atomic<std::size_t> tcacheListFactor_{16};
+    static inline std::atomic<std::size_t> spanPages_{8};
+    static inline std::atomic<std::size_t> minBlocksPerSpan_{4};
+    static inline std::atomic<std::size_t> coloring_{1};
+    static inline std::atomic<std::size_t> releaseThresholdPages_{kDefaultReleaseThresholdPages};
+    static inline std::atomic<std::size_t> softLimitBytes_{0};
+    static inline std::atomic<std::size_t> hardLimitBytes_{0};
+    static inline std::atomic<std::size_t> guardSampleRate_{0};
+    static inline std::atomic<std::size_t> guardSlots_{256};
+    static inline std::atomic<std::uint64_t> generation_{0};
+
+    /* 各 size-class 的批量覆盖值，0 表示使用 ThreadCache::batchNumForSize */
+    static inline std::array<std::atomic<std::uint16_t>, kFreeListNum> batch_{};
+};
+
+} // namespace mempool
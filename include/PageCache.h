@@ -2,21 +2,39 @@
 /**
  * class PageCache  — 以页为粒度的全局级分配器
  *  func:
- *      allocateSpan(numPages)       — 向系统申请或复用一段连续页
- *      freeSpan(addr, numPages)     — 将页段归还（目前 CentralCache 未用到，可留接口）
+ *      allocateSpan(numPages, zeroed, populate) — 向系统申请或复用一段连续页；zeroed 报告内容是否已知全零，
+ *                                   populate 要求返回前完成缺页（预热用）
+ *      freeSpan(addr, numPages)     — 将页段归还给其所属分片
+ *      prefault(addr, bytes)        — 让一段已持有的内存预先缺页，不改变其内容
+ *      reclaim()                    — 回收：让上层交回整段空闲的 span，再把空闲页还给系统
+ *
+ * 页堆被拆成 kShardNum 个互相独立的分片（Shard）：
+ *   - 每个分片拥有自己向系统申请的地址区间、空闲表与互斥锁，只在本分片内合并；
+ *   - 线程按轮转分配“主分片”，分配只走主分片，归还则经 PageMap 找到所属分片；
+ *   - 常用小 span（≤ kFastSpanMaxPages 页）另有无锁槽位缓存，命中时不碰互斥锁；
+ *   - 向系统申请页（mmap）始终在锁外进行。
+ *
+ * 内存上限（Options 的 limit.soft_bytes / limit.hard_bytes，按本实例向系统映射的字节计）：
+ *   - 超过软上限时回收一次（见 reclaim），并在回到软上限以下之前，归还的空闲块立即还给系统；
+ *   - 申请新页会超过硬上限、或 mmap 失败时，先 reclaim 再重试空闲表，仍不够才调用
+ *     OOM 处理器；处理器返回 true 表示已腾出内存、重新尝试，返回 false 则抛出 std::bad_alloc。
+ *
+ * “已知全零”：刚从 mmap 取得、或归还时已 MADV_DONTNEED 的 span 标记为 zeroed，
+ * 拆分保留标记，合并取与；上层据此跳过清零（见 MemoryPool::allocate_zeroed）。
  *
  * struct Span      — Span 信息结构体
  */
+#include <array>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
-#include <cstdlib> // aligned_alloc
 #include <map>
 #include <mutex>
 #include <new>
 #include <unordered_map>
-#include <unordered_set>
 
-#include "Common.h" // kPageSize
+#include "Common.h"  // kPageSize
+#include "PageMap.h" // 地址 → 分片
 
 namespace mempool
 {
@@ -26,62 +44,164 @@ struct Span {
     void* pageAddr{nullptr}; // 该 span 对应的起始页地址（已对齐至 kPageSize）
     std::size_t numPages{0}; // 该 span 包含的页数
     Span* next{nullptr};     // 同一桶中下一段 span
+    bool zeroed{false};      // 内容是否已知全零
 
     Span() = default; // 默认构造函数
 
     /* 构造一个包含 addr 开始、pages 页数的 Span */
-    Span(void* addr, std::size_t pages) : pageAddr(addr), numPages(pages) {}
+    Span(void* addr, std::size_t pages, bool zero = false)
+        : pageAddr(addr), numPages(pages), zeroed(zero) {}
 };
 
+/** OOM 处理器：参数为本次申请的字节数；返回 true 重试，false 放弃（抛出 std::bad_alloc） */
+using OomHandler = bool (*)(std::size_t bytes);
+
 class PageCache {
 public:
     /** 单例 */
     static PageCache& getInstance();
 
-    /** 分配 numPages 个连续页，返回首地址（对齐至 kPageSize） */
-    void* allocateSpan(std::size_t numPages);
+    /**
+     * 分配 numPages 个连续页，返回首地址（对齐至 kPageSize）；zeroed 非空时写回内容是否已知全零。
+     * populate 为 true 时返回前完成缺页：新页用 MAP_POPULATE，复用的页用 prefault。
+     */
+    void* allocateSpan(std::size_t numPages, bool* zeroed = nullptr, bool populate = false);
 
-    /** 归还 span */
+    /** 归还 span（可由任意线程归还，自动路由到所属分片） */
     void freeSpan(void* addr, std::size_t numPages);
 
-    /** 调试：空闲总页数 */
-    std::size_t freePages() const noexcept { return totalFreePages_; }
+    /**
+     * 预先缺页 [addr, addr + bytes)：优先 MADV_POPULATE_WRITE（不改内容），内核不支持时
+     * 逐页读后原值写回，只触碰区间内的字节，区间外的相邻块不受影响。
+     */
+    static void prefault(void* addr, std::size_t bytes) noexcept;
+
+    /**
+     * 回收：先调用上层注册的回收器（CentralCache 交回整段空闲的 span、请各线程收缩缓存），
+     * 再把各分片中完整空闲的系统块 munmap，其余空闲 span MADV_DONTNEED。
+     */
+    void reclaim();
+
+    /** 上层注册回收器（每个 PageCache 一个，由其 CentralCache 在构造时注册） */
+    void setReclaimer(void (*fn)(void*), void* ctx) noexcept {
+        reclaimCtx_ = ctx;
+        reclaimFn_ = fn;
+    }
+
+    /** 设置全局 OOM 处理器，返回之前的处理器 */
+    static OomHandler setOomHandler(OomHandler handler) noexcept {
+        return oomHandler_.exchange(handler, std::memory_order_acq_rel);
+    }
+
+    /** addr 是否位于本 PageCache 向系统申请的页内 */
+    bool owns(const void* addr) const noexcept { return pageMap_.get(addr) != 0; }
 
-    /* 超过此空闲页阈值（页数）时，自动释放回系统；默认 16K 页（约 64 MB） */
-    static constexpr std::size_t kReleaseThresholdPages = 16 * 1024; // 64 MB (4 K 页)
-    /* 记录所有系统级别实际分配的首地址，析构时统一释放 */
-    static std::unordered_set<void*> systemBases_;
+    /** 调试：空闲总页数（含无锁槽位中缓存的页） */
+    std::size_t freePages() const noexcept;
+
+    /** 统计：当前向系统持有的总页数（已借出 + 空闲） */
+    std::size_t systemPages() const noexcept;
+
+    /* 分片数量 */
+    static constexpr std::size_t kShardNum = 8;
+
+    /* 无锁快速路径覆盖的最大 span 页数，以及每种页数的槽位数 */
+    static constexpr std::size_t kFastSpanMaxPages = 16;
+    static constexpr std::size_t kFastSlotsPerSize = 4;
+
+    /* 归还不少于此页数的 span 时先 MADV_DONTNEED：交还物理页并使其变为已知全零 */
+    static constexpr std::size_t kDontNeedMinPages = 32;
 
 private:
-    PageCache() = default;
+    friend class Heap; // 独立堆各自持有一个 PageCache，析构即整体归还
+
+    PageCache();
     ~PageCache();
 
     PageCache(const PageCache&) = delete;
     PageCache& operator=(const PageCache&) = delete;
 
-    /** 从操作系统请求整段页内存（对齐到页大小） */
-    static void* systemAllocPages(std::size_t numPages);
+    /** 单个分片：自己的地址区间、空闲表、锁与无锁槽位 */
+    struct Shard {
+        /* 按页数升序的 size → Span*（链表）的 map */
+        std::map<std::size_t, Span*> freeSpans_;
+
+        /* 按地址升序的 **空闲** addr → Span* 的 map，用于相邻合并 */
+        std::map<void*, Span*> addrSpanMap_;
+
+        /* 本分片向系统实际申请的 首地址 → 页数，析构 / 回收时按此释放 */
+        std::unordered_map<void*, std::size_t> systemBases_;
+
+        /* 分片互斥：保护以上三张表 */
+        std::mutex mutex_;
+
+        /* 空闲表中的页数（锁内修改，锁外只读） */
+        std::atomic<std::size_t> freePages_{0};
+
+        /* 无锁槽位：fastSpans_[n][k] 缓存一段恰好 n 页的空闲 span */
+        std::array<std::array<std::atomic<void*>, kFastSlotsPerSize>, kFastSpanMaxPages + 1>
+            fastSpans_{};
+
+        /* 无锁槽位中缓存的页数 */
+        std::atomic<std::size_t> cachedPages_{0};
+
+        /* systemBases_ 覆盖的总页数 */
+        std::atomic<std::size_t> systemPages_{0};
+
+        /* 所属 PageCache 的页表：系统块归还前撤销登记 */
+        PageMap* pageMap_{nullptr};
+
+        /* ---------- 无锁快速路径 ---------- */
+        void* popFast(std::size_t numPages) noexcept;             // 取一段 n 页 span（内容未知）
+        bool pushFast(void* addr, std::size_t numPages) noexcept; // 放入空槽
+
+        /* ---------- 以下均需持有 mutex_ ---------- */
+        void* takeFromFreeLists(std::size_t numPages, bool& zeroed);       // 从空闲表取（必要时拆分）
+        void putToFreeLists(void* addr, std::size_t numPages, bool zeroed); // 合并后放回空闲表
+        bool drainFast();                                                   // 槽位中的 span 并回空闲表
+        void insertSpan(Span* span);                                        // 插入两张 map
+        void eraseSpan(Span* span);                                         // 双 map 都删
+        void mergeWithNeighbors(Span*& span);                               // 相邻页连续则合并
+        void releaseIfExcess(std::size_t threshold);                        // free 页超过 threshold 时回收
+        void trim();                                                        // 回收：整块归还 + DONTNEED
+        void releaseAll();                                                  // 析构：全部还给系统
+    };
+
+    /** 从操作系统请求整段页内存（mmap，天然对齐且全零），不持有任何锁；populate 时附加 MAP_POPULATE。
+        失败返回 nullptr，由调用者决定回收 / 重试 / 抛出 */
+    static void* systemAllocPages(std::size_t numPages, bool populate = false);
+
+    /** 第 3 步：在上限约束下向系统申请，必要时回收、调用 OOM 处理器；最终失败抛出 std::bad_alloc */
+    void* allocateFromSystem(Shard& sh, std::size_t numPages, bool populate, bool& zeroed);
+
+    /** 当前是否超过软上限 */
+    bool overSoftLimit() const noexcept;
+
+    /** 归还时使用的空闲页阈值：超过软上限时为 0（立即归还） */
+    std::size_t releaseThreshold() noexcept;
+
+    /** 把系统基址开始的 numPages 页还给操作系统 */
+    static void systemFreePages(void* base, std::size_t numPages);
+
+    /** 当前线程的主分片（首次调用时轮转分配） */
+    Shard& homeShard() noexcept;
 
-    /* 按页数升序的 size → Span*（链表）的 map */
-    std::map<std::size_t, Span*> freeSpans_;
+    /** addr 所属分片；未登记返回 nullptr */
+    Shard* ownerOf(void* addr) noexcept;
 
-    /* 按地址升序的 **空闲** addr → Span* 的 map，用于相邻合并 */
-    std::map<void*, Span*> addrSpanMap_;
+    std::array<Shard, kShardNum> shards_;
 
-    /* 全局互斥保护 */
-    std::mutex mutex_;
+    /* 页 → 分片编号 + 1（0 表示不属于本 PageCache） */
+    PageMap pageMap_;
 
-    /* 统计空闲总页数；超阈值时把大块释放回系统 */
-    std::size_t totalFreePages_{0};
+    /* 上层回收器 */
+    void (*reclaimFn_)(void*){nullptr};
+    void* reclaimCtx_{nullptr};
 
-    /* ---------- 内部辅助 ---------- */
-    void insertSpan(Span* span);          // 插入两张 map
-    void eraseSpan(Span* span);           // 双 map 都删
-    void mergeWithNeighbors(Span*& span); // 相邻页连续则合并
-    void releaseIfExcess();               // 当 free 页太多时回收
+    /* 本轮越过软上限后是否已回收过；回到软上限以下时清除 */
+    std::atomic<bool> softReclaimed_{false};
 
-    /* 活跃表：所有已借出（尚未 freeSpan）的 span。 span.addr → numPages */
-    std::unordered_map<void*, std::size_t> activeSpans_;
+    static inline std::atomic<OomHandler> oomHandler_{nullptr};
 };
 
 } // namespace mempool
@@ -0,0 +1,70 @@
+#pragma once
+/**
+ * class PageMap — 页号 → 归属分片 的三级基数树
+ *  func:
+ *      get(addr)                  — 查询 addr 所在页的归属值（0 表示未登记）
+ *      set(addr, numPages, value) — 把一段连续页登记为 value
+ *
+ * 48 位虚拟地址 / 4 KB 页 → 36 位页号，按 12/12/12 拆成三级，
+ * 中间层与叶子均按需创建，只增不删；读路径完全无锁。
+ */
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "Common.h" // kPageSize
+
+namespace mempool
+{
+
+class PageMap {
+public:
+    static constexpr std::size_t kLevelBits = 12;
+    static constexpr std::size_t kLevelSize = std::size_t{1} << kLevelBits;
+    static constexpr std::size_t kPageShift = 12; // log2(kPageSize)
+
+    static_assert((std::size_t{1} << kPageShift) == kPageSize, "kPageShift mismatch");
+
+    PageMap() = default;
+    ~PageMap();
+
+    PageMap(const PageMap&) = delete;
+    PageMap& operator=(const PageMap&) = delete;
+
+    /** 查询 addr 所在页的归属值；未登记返回 0 */
+    std::uint8_t get(const void* addr) const noexcept {
+        std::uintptr_t pn = reinterpret_cast<std::uintptr_t>(addr) >> kPageShift;
+        Mid* mid = root_[rootIndex(pn)].load(std::memory_order_acquire);
+        if (!mid) return 0;
+        Leaf* leaf = mid->leaves[midIndex(pn)].load(std::memory_order_acquire);
+        if (!leaf) return 0;
+        return leaf->owner[leafIndex(pn)].load(std::memory_order_relaxed);
+    }
+
+    /** 把 [addr, addr + numPages 页) 登记为 value（同一段页只会由一个分片写入） */
+    void set(const void* addr, std::size_t numPages, std::uint8_t value);
+
+private:
+    struct Leaf {
+        std::array<std::atomic<std::uint8_t>, kLevelSize> owner{};
+    };
+    struct Mid {
+        std::array<std::atomic<Leaf*>, kLevelSize> leaves{};
+    };
+
+    static std::size_t rootIndex(std::uintptr_t pn) noexcept {
+        return (pn >> (2 * kLevelBits)) & (kLevelSize - 1);
+    }
+    static std::size_t midIndex(std::uintptr_t pn) noexcept {
+        return (pn >> kLevelBits) & (kLevelSize - 1);
+    }
+    static std::size_t leafIndex(std::uintptr_t pn) noexcept { return pn & (kLevelSize - 1); }
+
+    /* 取得（必要时创建）pn 对应的叶子 */
+    Leaf* ensureLeaf(std::uintptr_t pn);
+
+    std::array<std::atomic<Mid*>, kLevelSize> root_{};
+};
+
+} // namespace mempool
@@ -0,0 +1,116 @@
+#pragma once
+/**
+ * class SharedPool — 跨进程共享的内存池（memfd / 文件以 MAP_SHARED 映射到固定基址）
+ *  func:
+ *      create(path, bytes, base) — 新建区域；path 为 nullptr 时使用 memfd（经 fork / SCM_RIGHTS 传递 fd）
+ *      attach(path) / attach(fd) — 映射已有区域（另一进程，或重启后热恢复）
+ *      allocate(size)   — 在共享区域中分配，任何已映射该区域的进程都可读写 / 释放
+ *      deallocate(ptr)  — 归还（可以由另一进程调用）
+ *      offsetOf(ptr) / at(offset) — 指针 ↔ 区域内偏移
+ *      root() / setRoot(offset)   — 区域内的根偏移，重启后据此找回数据结构
+ *
+ * 区域布局：[Region 头部][页区]。头部保存魔数、大小、映射基址、进程共享锁、
+ * 页区空闲 span 链与各 size-class 空闲链；所有链接都以“相对区域起点的偏移”保存，
+ * 与映射地址无关。区域总映射到创建时指定的固定基址（MAP_FIXED_NOREPLACE），
+ * 因此各进程拿到的指针也相同，可以直接放进共享的数据结构。
+ *
+ * 与进程内的 MemoryPool 不同：
+ *  - 没有 ThreadCache：进程崩溃时线程缓存里的块会永久丢失，因此每次分配 / 释放都在
+ *    进程共享锁下直接操作区域内的链表（size-class 按下标分为 kLockStripes 组加锁）。
+ *    适合大消息、低频率的跨进程传递，而不是高频小对象。
+ *  - 锁为 robust 互斥量：持锁进程死亡后，下一个加锁者接手并继续（可能泄漏那一次操作涉及的块）。
+ *  - 共享映射上 MADV_DONTNEED 不会清零也不会释放文件页，因此不做归还系统 / 已知全零的优化。
+ *
+ * 区域大小在创建时固定（文件为稀疏文件，页首次写入时才占用）；用尽时 allocate 抛出 std::bad_alloc。
+ */
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <pthread.h>
+
+#include "Common.h" // BlockHeader / SizeClass / kMaxBytes / kPageSize
+
+namespace mempool
+{
+
+class SharedPool {
+public:
+    /* 默认映射基址：远离常见的堆 / mmap / 栈区 */
+    static inline void* const kDefaultBase = reinterpret_cast<void*>(std::uintptr_t(0x6000'0000'0000));
+
+    /* size-class 锁的分组数 */
+    static constexpr std::size_t kLockStripes = 64;
+
+    /**
+     * 新建区域并映射到 base。path 非空时创建文件（已存在则失败，避免覆盖可热恢复的数据），
+     * 为空时使用 memfd。base 为 nullptr 时由内核选址（之后 attach 仍映射到同一地址；
+     * 互不相关的进程之间，事先约定的固定基址更不容易被占用）。失败返回 nullptr（errno 指明原因）。
+     */
+    static std::unique_ptr<SharedPool> create(const char* path, std::size_t bytes, void* base = kDefaultBase);
+
+    /** 映射已有区域：按头部记录的基址与大小；地址被占用或头部不合法时返回 nullptr */
+    static std::unique_ptr<SharedPool> attach(const char* path);
+    static std::unique_ptr<SharedPool> attach(int fd); // fd 会被 dup，调用者仍保有原 fd
+
+    /** 解除映射并关闭 fd；区域内容保留在文件 / memfd 中 */
+    ~SharedPool();
+
+    SharedPool(const SharedPool&) = delete;
+    SharedPool& operator=(const SharedPool&) = delete;
+
+    /** 分配 size 字节；区域用尽时抛出 std::bad_alloc */
+    void* allocate(std::size_t size);
+
+    /** 归还本区域分配的内存（任何映射了该区域的进程都可调用） */
+    void deallocate(void* ptr);
+
+    /** ptr 是否位于本区域的页区 */
+    bool owns(const void* ptr) const noexcept {
+        auto p = reinterpret_cast<std::uintptr_t>(ptr);
+        auto b = reinterpret_cast<std::uintptr_t>(base_);
+        return p >= b + dataOffset() && p < b + bytes_;
+    }
+
+    /** 指针 → 区域内偏移（跨进程传递时使用，0 保留表示空） */
+    std::uint64_t offsetOf(const void* ptr) const noexcept {
+        return ptr ? static_cast<std::uint64_t>(static_cast<const char*>(ptr) - base_) : 0;
+    }
+
+    /** 区域内偏移 → 本进程指针 */
+    void* at(std::uint64_t offset) const noexcept { return offset ? base_ + offset : nullptr; }
+
+    /** 根偏移：热恢复时找回数据结构的入口 */
+    std::uint64_t root() const noexcept;
+    void setRoot(std::uint64_t offset) noexcept;
+
+    /** 映射基址 / 区域字节数 / 底层 fd */
+    void* base() const noexcept { return base_; }
+    std::size_t size() const noexcept { return bytes_; }
+    int fd() const noexcept { return fd_; }
+
+    /** 页区当前空闲（未分配给 span / 大对象）的字节数 */
+    std::size_t freeBytes() const;
+
+private:
+    struct Region; // 区域头部，定义见 SharedPool.cpp
+
+    SharedPool(int fd, char* base, std::size_t bytes) : fd_(fd), base_(base), bytes_(bytes) {}
+
+    Region* region() const noexcept { return reinterpret_cast<Region*>(base_); }
+    static std::size_t dataOffset() noexcept;
+
+    /* 页区：持 pageLock 调用；失败返回 0 */
+    std::uint64_t allocPages(std::size_t pages);
+    void freePages(std::uint64_t offset, std::size_t pages);
+
+    /* 为 size-class 切一个新 span 挂入空闲链（持该类的锁调用） */
+    void refillClass(std::size_t index);
+
+    int fd_;
+    char* base_;
+    std::size_t bytes_;
+};
+
+} // namespace mempool
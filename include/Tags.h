@@ -0,0 +1,92 @@
+#pragma once
+/**
+ * class Tags — 分配标签：按子系统统计内存占用，可选软预算
+ *  func:
+ *      attach(ptr, tag)     — 给刚分配的块打标签并计入该标签（MemoryPool::allocate(size, tag) 调用）
+ *      attachCurrent(ptr)   — 按本线程当前作用域的标签打标签（TagScope 生效时由 allocate 调用）
+ *      onFree(tag, bytes)   — 释放带标签的块时扣减（ThreadCache::deallocate 的慢路径调用）
+ *      stats(tag)           — 汇总所有线程的计数
+ *      setBudget(tag, bytes) / setBudgetHandler(fn) — 软预算：超出时回调，不拒绝分配
+ *
+ * 标签存放在 BlockHeader::size 的最高 8 位（kTagShift 起），0 表示无标签，可用 1..kMaxTags-1；
+ * 紧挨着的第 55 位是守护块标记（Guard::kGuardedFlag），不属于大小。
+ * 带标签块的 size 必然大于 kMaxBytes，释放时自然落入 ThreadCache::deallocate 原有的
+ * “大对象”慢分支，在那里剥离标签；无标签块的释放路径一条指令都不多。
+ * 分配一侧只在 MemoryPool::allocate 返回前检查一次全局开关（与 Trace 相同），
+ * 开关在首次使用标签时打开。
+ *
+ * 计数：每线程一份（只由本线程写），stats() 时跨线程求和；线程退出时并入全局累计。
+ * 本线程计数析构之后（其它 TLS 析构函数中）的分配 / 释放在锁内直接记入全局累计。
+ * 块可以在另一线程释放，因此单个线程的存活字节可能为负，求和后才有意义。
+ * 分配速率由调用者对两次 stats() 的 allocCount / allocBytes 取差得到。
+ */
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "Common.h" // BlockHeader
+#include "Guard.h"  // kGuardedFlag
+
+namespace mempool
+{
+
+/** 单个标签的汇总计数 */
+struct TagStats {
+    std::int64_t liveBytes{0};    // 当前存活字节（按块的用户字节数计）
+    std::uint64_t allocCount{0};  // 累计分配次数
+    std::uint64_t allocBytes{0};  // 累计分配字节
+    std::uint64_t freeCount{0};   // 累计释放次数
+};
+
+class Tags {
+public:
+    using Tag = std::uint8_t;
+
+    static constexpr std::size_t kMaxTags = 256;
+    static constexpr unsigned kTagShift = 56;
+    static constexpr std::uint64_t kSizeMask = Guard::kGuardedFlag - 1;
+
+    /** 超出软预算时的回调：标签与当时汇总的存活字节；每次越线只调用一次 */
+    using BudgetHandler = void (*)(Tag tag, std::int64_t liveBytes);
+
+    /** 快速路径上的开关检查 */
+    static bool enabled() noexcept { return enabled_.load(std::memory_order_relaxed); }
+
+    /** 给 ptr 打上 tag 并计数；tag 为 0 或 ptr 为空时什么都不做 */
+    static void attach(void* ptr, Tag tag) noexcept;
+
+    /** 按本线程当前标签打标签 */
+    static void attachCurrent(void* ptr) noexcept {
+        if (current_) attach(ptr, current_);
+    }
+
+    /** 释放带标签的块时调用（bytes 为剥离标签后的 size） */
+    static void onFree(Tag tag, std::size_t bytes) noexcept;
+
+    /** 本线程当前标签；TagScope 负责切换 */
+    static Tag current() noexcept { return current_; }
+    static void setCurrent(Tag tag) noexcept {
+        current_ = tag;
+        if (tag && !enabled()) enabled_.store(true, std::memory_order_relaxed);
+    }
+
+    /** 块头中的标签 / 去掉标签后的大小 */
+    static Tag tagOf(std::uint64_t size) noexcept { return static_cast<Tag>(size >> kTagShift); }
+    static std::size_t sizeOf(std::uint64_t size) noexcept { return size & kSizeMask; }
+
+    /** 汇总所有线程（含已退出线程）的计数 */
+    static TagStats stats(Tag tag);
+
+    /** 软预算，0 为不限 */
+    static void setBudget(Tag tag, std::size_t bytes) noexcept;
+    static BudgetHandler setBudgetHandler(BudgetHandler handler) noexcept;
+
+    /** 每个线程每分配这么多次带预算的标签块，汇总检查一次预算 */
+    static constexpr std::uint32_t kBudgetCheckInterval = 256;
+
+private:
+    static inline std::atomic<bool> enabled_{false};
+    static inline thread_local Tag current_ = 0;
+};
+
+} // namespace mempool
@@ -2,57 +2,305 @@
 /**
  * class ThreadCache — 线程独享的内存分配器
  *  func:
- *      allocate(size)   — 先查本地空闲链；不够则从 CentralCache 拉批量
+ *      allocate(size)   — 先查本地空闲链，再从未切分区间顺序切块；都没有则从 CentralCache 拉批量
+ *      allocateZeroed(size) — 同上但保证内容全零；来自已知全零区间的块跳过清零
  *      deallocate(ptr)  — 解析 BlockHeader 获取大小后挂回本地链
- *                         当本地链过长时，回收一部分给 CentralCache
+ *                         当本地链过长或本线程缓存超出字节预算时，回收一部分给 CentralCache
+ *      reserve(size, count) — 预热：让本地备有 count 个区块（不超过本地链上限）
+ *      flush()          — 把本地缓存（空闲链 + 未切分区间）全部交回 CentralCache
+ *      pin() / unpin()  — 进入 / 离开纪元读临界区（可嵌套），见 Epoch.h
+ *      retire(ptr)      — 延迟回收：到期前挂在本线程的退休链上，到期后回到本地空闲链
+ *      collectRetired() — 尽力推进纪元并释放到期的退休块
+ *
+ * 快速路径：getInstance / allocate / deallocate 的命中部分都内联在头文件中。
+ * 守护页采样（Guard.h）在 allocate 中只占一次计数器递减与判断。
+ * 本线程实例经 initial-exec 模型的 TLS 指针访问（无需 __tls_get_addr，也没有动态初始化守卫），
+ * 指针为空时才进入 initSlow 构造实例。作为 dlopen 载入的共享库使用时，
+ * 静态 TLS 空间可能不足，可定义 MEMPOOL_NO_INITIAL_EXEC 退回默认 TLS 模型。
+ *
+ * 线程退出：本线程的默认池实例析构时 flush，空闲块回到 CentralCache（独立堆的实例由 Heap 处理），
+ * 随后 current() 返回 nullptr；更晚的 TLS 析构函数中的分配 / 归还经 allocateDirect / deallocateDirect
+ * 逐块直接找 CentralCache，EpochGuard 为空操作，retire 直接交给孤儿表。
+ *
+ * 收缩请求：CentralCache::reclaim 递增收缩纪元，各线程在下一次 deallocate / 补货时发现纪元变化，
+ * 执行一次 flush。长期不再分配 / 释放的线程不会响应。
  */
 #include <array>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 
 #include "CentralCache.h" // CentralCache::fetchRange / returnRange
 #include "Common.h"       // BlockHeader / SizeClass / kFreeListNum …
+#include "Epoch.h"        // 延迟回收的纪元登记
+#include "Guard.h"        // 守护页采样
+#include "Options.h"      // 运行期批量 / 链长 / 字节预算
+
+#if defined(__GNUC__) && !defined(MEMPOOL_NO_INITIAL_EXEC)
+#define MEMPOOL_TLS_MODEL __attribute__((tls_model("initial-exec")))
+#else
+#define MEMPOOL_TLS_MODEL
+#endif
 
 namespace mempool
 {
 
 class ThreadCache {
 public:
-    /** 当前线程唯一实例 */
-    static ThreadCache& getInstance();
+    /** 当前线程实例；线程退出阶段实例已析构后（更晚的 TLS 析构函数中）返回 nullptr */
+    static inline ThreadCache* current() {
+        if (ThreadCache* tc = tls_) [[likely]]
+            return tc;
+        return initSlow();
+    }
+
+    /** 当前线程唯一实例；实例析构后不可调用（改用 current） */
+    static inline ThreadCache& getInstance() { return *current(); }
+
+    /**
+     * 实例析构后的分配 / 归还：不经本地缓存，逐块直接向 CentralCache 取 / 还（大对象照常 malloc / free）。
+     * 只在线程退出阶段使用，不采样守护页。
+     */
+    static void* allocateDirect(std::size_t size, bool zero = false);
+    static void deallocateDirect(void* ptr);
 
     /** 分配 size 字节：返回用户区域首地址 */
-    void* allocate(std::size_t size);
+    inline void* allocate(std::size_t size) {
+        if (--sampleLeft_ == 0) [[unlikely]]
+            if (void* p = allocateSampled(size)) return p;
+
+        if (size == 0) size = kAlignment;
+        if (size > kMaxBytes) [[unlikely]]
+            return allocateLarge(size);
+
+        /* 小对象：先尝试本线程空闲链 */
+        std::size_t index = SizeClass::getIndex(size);
+        if (BlockHeader* hd = freeList_[index]) [[likely]] {
+            freeList_[index] = hd->next;
+            freeListSize_[index]--;
+            cachedBytes_ -= SizeClass::blockBytes(index);
+            return hd + 1;
+        }
+
+        /* 其次从新 span 的未切分区间顺序切块 */
+        if (bumpCur_[index] != bumpEnd_[index]) return carve(index);
+
+        /* 都为空则向 CentralCache 批量要 */
+        return fetchFromCentralCache(index);
+    }
+
+    /** 分配 size 字节并清零：只有回收块与非全零区间的块才需要真正清零 */
+    void* allocateZeroed(std::size_t size);
 
     /** 归还内存：无需再传 size */
-    void deallocate(void* ptr);
+    inline void deallocate(void* ptr) {
+        if (!ptr) return;
+
+        auto* hd = reinterpret_cast<BlockHeader*>(ptr) - 1;
+        std::size_t bytes = hd->size;
+
+        /* 大对象，或带分配标签 / 守护标记的块（位于 size 高位，见 Tags.h / Guard.h） */
+        if (bytes > kMaxBytes) [[unlikely]] {
+            deallocateLarge(hd);
+            return;
+        }
+
+        std::size_t index = SizeClass::getIndex(bytes);
+        hd->next = freeList_[index];
+        freeList_[index] = hd;
+        freeListSize_[index]++;
+        cachedBytes_ += SizeClass::blockBytes(index);
+
+        /* 链长 / 字节预算 / 收缩纪元 / 参数代数：都与本线程缓存的副本比较，越线或变化才进入慢路径 */
+        if (freeListSize_[index] > listLimit_[index] || cachedBytes_ > budget_ ||
+            CentralCache::trimEpoch() != trimSeen_ || Options::generation() != optionsSeen_) [[unlikely]]
+            deallocateSlow(hd, index);
+    }
+
+    /**
+     * 预热：从 CentralCache 取块，直到本地链 + 未切分区间至少有 count 块，返回本地可用块数。
+     * count 超过本地链上限（batch * tcache.list_factor）时只取到上限，其余留在 CentralCache。
+     */
+    std::size_t reserve(std::size_t size, std::size_t count);
+
+    /** 把本地全部缓存交回 CentralCache，之后交还已全空的 span */
+    void flush();
+
+    /** 进入读临界区：最外层才登记当前全局纪元，全屏障保证之后的读取晚于登记 */
+    inline void pin() {
+        if (pinDepth_++ == 0) {
+            if (!epochRec_) [[unlikely]]
+                epochRec_ = Epoch::acquire();
+            epochRec_->pinned.store(Epoch::global(), std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    /** 离开读临界区 */
+    inline void unpin() noexcept {
+        if (--pinDepth_ == 0) epochRec_->pinned.store(0, std::memory_order_release);
+    }
+
+    /**
+     * 延迟回收：ptr 按当前全局纪元挂入退休链（经 BlockHeader::next 串联），
+     * 全局纪元前进 Epoch::kGracePeriods 格后才 deallocate 回本地空闲链。
+     * 每退休 kRetireScanInterval 块顺带尝试推进纪元并批量释放到期块。
+     */
+    void retire(void* ptr);
+
+    /** 尽力回收：至多推进 kGracePeriods 格，释放本线程与孤儿表中到期的块，返回本线程仍在等待的块数 */
+    std::size_t collectRetired();
+
+    /** 实例已析构后的退休：不再有本地退休链，按当前纪元直接交给孤儿表 */
+    static void retireOrphan(void* ptr);
 
 private:
-    ThreadCache();
-    ~ThreadCache() = default;
+    friend class Heap; // 独立堆为每个线程另建 ThreadCache
+
+    explicit ThreadCache(CentralCache& central);
+    ~ThreadCache(); // 默认池实例先 flush；未到期的退休块交给孤儿表，归还纪元记录
 
     ThreadCache(const ThreadCache&) = delete;
     ThreadCache& operator=(const ThreadCache&) = delete;
 
-    /** 当本地空链为空时，从 CentralCache 批量抓取 */
+    /** 线程首次使用时构造实例并写入 tls_；实例已析构时返回 nullptr */
+    static ThreadCache* initSlow();
+
+    /** size > kMaxBytes：malloc 并补上头部 */
+    static void* allocateLarge(std::size_t size);
+
+    /** 采样计数到 0：重置计数并尝试在守护槽位上分配，未采样时返回 nullptr（独立堆不采样） */
+    void* allocateSampled(std::size_t size);
+
+    /** size > kMaxBytes：剥离标签并扣减计数；守护块交回 Guard，仍是大对象则交由系统释放，否则按小块归还 */
+    void deallocateLarge(BlockHeader* hd);
+
+    /** deallocateLarge 的前半：已就地释放返回 true；剥离标签后仍是小块时写回大小并返回 false */
+    static bool releaseLarge(BlockHeader* hd);
+
+    /** 归还的慢路径：刷新缓存的上限后再判断是否回收 / 收缩 */
+    void deallocateSlow(BlockHeader* hd, std::size_t index);
+
+    /** 从未切分区间切出一块并写入头部 */
+    inline void* carve(std::size_t index) noexcept {
+        auto* hd = reinterpret_cast<BlockHeader*>(bumpCur_[index]);
+        bumpCur_[index] += SizeClass::blockBytes(index);
+        hd->size = SizeClass::userBytes(index);
+        hd->next = nullptr;
+        return hd + 1;
+    }
+
+    /** 本地可用块数：空链长度 + 未切分区间块数 */
+    inline std::size_t localBlocks(std::size_t index) const noexcept {
+        return freeListSize_[index] +
+               static_cast<std::size_t>(bumpEnd_[index] - bumpCur_[index]) / SizeClass::blockBytes(index);
+    }
+
+    /** 未切分区间剩余的块逐个切出、挂入本地链 */
+    void spillBumpToList(std::size_t index) noexcept;
+
+    /** 收缩纪元变化时 flush */
+    inline void checkTrim() {
+        if (CentralCache::trimEpoch() != trimSeen_) [[unlikely]] flush();
+    }
+
+    /** 当本地空链与未切分区间都为空时，从 CentralCache 批量抓取 */
     void* fetchFromCentralCache(std::size_t index);
 
+    /** 从 CentralCache 取一批填入本地链 / 未切分区间；一块都没拿到返回 false */
+    bool refillFromCentralCache(std::size_t index);
+
     /** 当本地空链过长时，将一部分区块归还给 CentralCache */
     void returnToCentralCache(BlockHeader* start, std::size_t index);
 
-    /** 根据区块大小决定一次批量抓取多少块 */
-    static std::size_t batchNumForSize(std::size_t bytes) noexcept;
+    /** 根据区块大小决定一次批量抓取多少块（默认策略）：越小的块一次拿越多 */
+    static constexpr std::size_t batchNumForSize(std::size_t bytes) noexcept {
+        if (bytes <= 128) return 512;  // 128 B
+        if (bytes <= 1024) return 128; // 1 KB
+        if (bytes <= 8192) return 32;  // 8 KB
+        if (bytes <= 65536) return 8;  // 64 KB
+        return 4;                      // 64 KB < bytes <= kMaxBytes
+    }
+
+    /** 该 size-class 实际的批量：tcache.batch.<bytes> 覆盖优先 */
+    static inline std::size_t batchNum(std::size_t index) noexcept {
+        if (std::size_t b = Options::batchOverride(index)) return b;
+        return batchNumForSize(SizeClass::userBytes(index));
+    }
+
+    /** 本地链上限：batch * tcache.list_factor */
+    static inline std::size_t listLimit(std::size_t index) noexcept {
+        return batchNum(index) * Options::tcacheListFactor();
+    }
 
     /** 判断该 index 的空链是否需要回收给 CentralCache */
     inline bool shouldReturnToCentralCache(std::size_t index) const noexcept {
-        /** 阈值：保持链表大小不超过 batch * 16 */
-        return freeListSize_[index] > batchNumForSize((index + 1) * kAlignment) * 16;
+        /** 阈值：链表不超过 listLimit，且全线程缓存不超过 tcache.max_bytes（0 为不限） */
+        if (freeListSize_[index] > listLimit(index)) return true;
+        std::size_t budget = Options::tcacheMaxBytes();
+        return budget && cachedBytes_ > budget;
     }
 
+    /** 逐块 deallocate 一条退休链 */
+    void freeRetiredChain(BlockHeader* head);
+
+    /** 释放本线程已到期的退休链，并接手到期的孤儿块 */
+    void releaseExpiredRetired();
+
+    /** 每退休这么多块尝试一次推进纪元 + 批量释放 */
+    static constexpr std::size_t kRetireScanInterval = 64;
+
+    /** 批量取块 / 归还的对象：默认实例为全局 CentralCache */
+    CentralCache& central_;
+
     /** 每个 size-class 的空闲链表头指针 */
     std::array<BlockHeader*, kFreeListNum> freeList_{};
 
     /** 对应空链当前区块数量 */
     std::array<std::size_t, kFreeListNum> freeListSize_{};
+
+    /** 所有空链中区块的总字节数（含头部），与 tcache.max_bytes 比较 */
+    std::size_t cachedBytes_{0};
+
+    /** 最近一次响应的收缩纪元 */
+    std::uint64_t trimSeen_{0};
+
+    /** 快速路径使用的上限副本：各类链长上限（0 表示尚未计算）与字节预算（不限时为最大值），
+        在慢路径中按 Options 刷新 */
+    std::array<std::uint32_t, kFreeListNum> listLimit_{};
+    std::size_t budget_{SIZE_MAX};
+
+    /** 上面两项副本对应的参数代数（Options::generation），变化时整体作废 */
+    std::uint64_t optionsSeen_{0};
+
+    /** 距下一次守护页采样还剩的分配次数（见 Guard::nextInterval） */
+    std::uint32_t sampleLeft_{Guard::kDisabledInterval};
+
+    /** 本线程实例（initial-exec TLS） */
+    static inline thread_local ThreadCache* tls_ MEMPOOL_TLS_MODEL = nullptr;
+
+    /** 本线程的默认池实例已析构：tls_ 随之清空，initSlow 不再构造 */
+    static inline thread_local bool tornDown_ MEMPOOL_TLS_MODEL = false;
+
+    /** 每个 size-class 从新 span 领到、尚未切分的区间 [bumpCur_, bumpEnd_) */
+    std::array<char*, kFreeListNum> bumpCur_{};
+    std::array<char*, kFreeListNum> bumpEnd_{};
+
+    /** 对应未切分区间的内容是否已知全零 */
+    std::array<bool, kFreeListNum> bumpZeroed_{};
+
+    /** 退休链：按退休纪元 % 3 分格，同一格中的块都在 epoch 纪元退休 */
+    struct RetireBag {
+        BlockHeader* head{nullptr};
+        std::size_t count{0};
+        std::uint64_t epoch{0};
+    };
+    std::array<RetireBag, Epoch::kGracePeriods + 1> retired_{};
+    std::size_t retiredSinceScan_{0};
+
+    /** 本线程的纪元记录（首次 pin 时领取）与临界区嵌套深度 */
+    EpochRecord* epochRec_{nullptr};
+    std::uint32_t pinDepth_{0};
 };
 
 } // namespace mempool
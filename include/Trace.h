@@ -0,0 +1,73 @@
+#pragma once
+/**
+ * class Trace — 分配轨迹记录（可选，运行期开关）
+ *  func:
+ *      start(path)              — 开始记录，事件写入 path（二进制）
+ *      stop()                   — 停止记录，刷出所有线程缓冲并关闭文件
+ *      recordAlloc(ptr, size)   — 由 MemoryPool::allocate 在开启时调用
+ *      recordFree(ptr)          — 由 MemoryPool::deallocate 在开启时调用（须在真正回收之前）
+ *
+ * 也可通过环境变量 MEMPOOL_TRACE=<path> 在启动时自动开启。
+ *
+ * 每个线程先写入自己的缓冲区，满 kBufferEvents 条后整块写入文件。
+ * 对象编号在分配时写入 BlockHeader::next（对象存活期间该字段闲置），
+ * 释放时据此找回编号；未被记录的对象（开启前分配）其 next 不带 kTracedBit，释放时直接跳过。
+ *
+ * 文件格式：TraceFileHeader + 若干 TraceEvent；同一线程的事件按时间先后排列。
+ */
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "Common.h" // BlockHeader
+
+namespace mempool
+{
+
+enum class TraceOp : std::uint8_t { Alloc = 1, Free = 2 };
+
+/** 单条事件（24 B） */
+struct TraceEvent {
+    std::uint64_t timestampNs; // steady_clock 纳秒
+    std::uint64_t objectId;    // 对象编号（含 kTracedBit）
+    std::uint32_t size;        // 分配字节数（Free 为 0；超过 4 GB 时饱和）
+    std::uint16_t threadId;    // 记录线程的紧凑编号（从 0 开始）
+    TraceOp op;
+    std::uint8_t reserved{0};
+};
+static_assert(sizeof(TraceEvent) == 24, "TraceEvent must stay compact");
+
+/** 文件头 */
+struct TraceFileHeader {
+    char magic[8];           // "MPTRACE\0"
+    std::uint32_t version;   // kTraceVersion
+    std::uint32_t eventSize; // sizeof(TraceEvent)
+};
+
+constexpr char kTraceMagic[8] = {'M', 'P', 'T', 'R', 'A', 'C', 'E', '\0'};
+constexpr std::uint32_t kTraceVersion = 1;
+
+class Trace {
+public:
+    /* 对象编号最高位：区分“已记录对象”与闲置的 next 字段 */
+    static constexpr std::uint64_t kTracedBit = std::uint64_t{1} << 63;
+    /* 每线程缓冲的事件数 */
+    static constexpr std::size_t kBufferEvents = 4096;
+
+    /** 开始记录；文件无法打开或已在记录时返回 false */
+    static bool start(const char* path);
+
+    /** 停止记录 */
+    static void stop();
+
+    /** 快速路径上的开关检查 */
+    static bool enabled() noexcept { return enabled_.load(std::memory_order_relaxed); }
+
+    static void recordAlloc(void* ptr, std::size_t size) noexcept;
+    static void recordFree(void* ptr) noexcept;
+
+private:
+    static inline std::atomic<bool> enabled_{false};
+};
+
+} // namespace mempool
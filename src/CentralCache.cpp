@@ -1,64 +1,132 @@
 #include "CentralCache.h"
 
+#include <algorithm> // std::max / std::sort / std::upper_bound
 #include <cassert>
+#include <chrono>
 #include <cstring> // std::memset
+#include <mutex>   // std::lock_guard
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#include <x86intrin.h> // __rdtsc
+#endif
+
+#include "Options.h" // central.span_pages / central.min_blocks_per_span
 
 namespace mempool
 {
 
+/* 周期计数：x86-64 读 TSC，其它平台退化为纳秒 */
+static inline std::uint64_t cycleNow() noexcept {
+#ifdef __x86_64__
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+static inline void cpuRelax() noexcept {
+#ifdef __x86_64__
+    /**
+     *  在这里插入 PAUSE 指令：
+        （1）在 Intel/AMD CPU 上，PAUSE 会告诉处理器“我正在做忙等”，
+            有助于减少功耗并降低总线/缓存一致性流量。
+        （2）在超线程（SMT）环境下，它还能让出执行资源给同核的另一个硬线程，
+            提高整体吞吐量、减少忙等对同核任务的干扰。
+        （3）它是单周期指令，开销远低于 yield 或 sleep_for。
+     */
+    _mm_pause();
+#else
+    // 非 x86-64 平台无法使用 PAUSE，直接继续忙等
+    ;
+#endif
+}
+
+/* 竞争路径：有界指数退避自旋，失败后以 futex 挂起 */
+void AdaptiveLock::lockSlow() noexcept {
+    const std::uint64_t t0 = cycleNow();
+
+    /* 1) 退避自旋：1, 2, 4 … kMaxBackoff 次 PAUSE 后各试一次 */
+    for (std::uint32_t backoff = 1; backoff <= kMaxBackoff; backoff <<= 1) {
+        for (std::uint32_t i = 0; i < backoff; ++i)
+            cpuRelax();
+
+        std::uint32_t expected = 0;
+        if (state_.load(std::memory_order_relaxed) == 0 &&
+            state_.compare_exchange_weak(expected, 1, std::memory_order_acquire,
+                                         std::memory_order_relaxed)) {
+            bump(acquisitions_);
+            bump(contended_);
+            bump(spinCycles_, cycleNow() - t0);
+            return;
+        }
+    }
+
+    /* 2) 挂起：置 2 表示有等待者，解锁方据此决定是否 notify */
+    const std::uint64_t spun = cycleNow() - t0;
+    while (state_.exchange(2, std::memory_order_acquire) != 0)
+        state_.wait(2, std::memory_order_relaxed);
+
+    bump(acquisitions_);
+    bump(contended_);
+    bump(spinCycles_, spun);
+    bump(parks_);
+}
+
 /* 单例实现 */
 CentralCache& CentralCache::getInstance() {
-    static CentralCache cc;
+    static CentralCache cc(PageCache::getInstance());
     return cc;
 }
 
 /* 初始化 */
-CentralCache::CentralCache() {
+CentralCache::CentralCache(PageCache& pageCache) : pageCache_(pageCache) {
     for (auto& p : centralFreeList_)
         p.store(nullptr, std::memory_order_relaxed);
+    pageCache_.setReclaimer(&CentralCache::reclaimThunk, this);
 }
 
-/* 分配 batchNum 个 blocks 的链表*/
-BlockHeader* CentralCache::fetchBatch(std::size_t index, std::size_t batchNum) {
+/* 取至多 batchNum 个区块：回收链优先，其余从未切分区间划出 */
+BlockBatch CentralCache::fetchBatch(std::size_t index, std::size_t batchNum) {
     assert(index < kFreeListNum && "size-class index out of range");
 
-    SpinLock& lk = locks_[index];
-    lk.lock();
+    BlockBatch batch;
+    const std::size_t blkBytes = SizeClass::blockBytes(index);
 
-    /* 链表计数 */
-    std::size_t available = 0;
-    for (BlockHeader* p = centralFreeList_[index].load(std::memory_order_relaxed);
-         p && available < batchNum; p = p->next)
-        ++available;
-    /* 若空链不足 batchNum，则补充一次 span */
-    if (available < batchNum) refillFromPageCache(index);
+    /* 补货可能抛出 std::bad_alloc（硬上限），用 lock_guard 保证解锁 */
+    std::lock_guard<AdaptiveLock> lg(locks_[index]);
 
-    /* 重新取头指针 */
+    /* 1) 从回收链拆下至多 batchNum 个节点 */
     BlockHeader* head = centralFreeList_[index].load(std::memory_order_relaxed);
-    if (!head) {
-        lk.unlock();
-        return nullptr;
-    } // 极端：PageCache 也失败
-
-    /* 从链表中拆下 batchNum 个节点 */
-    BlockHeader* curr = head;
-    BlockHeader* prev = nullptr;
-    std::size_t cnt = 0;
-
-    while (curr && cnt < batchNum) {
-        prev = curr;
-        curr = curr->next;
-        ++cnt;
+    if (head) {
+        BlockHeader* prev = nullptr;
+        BlockHeader* curr = head;
+        while (curr && batch.listCount < batchNum) {
+            prev = curr;
+            curr = curr->next;
+            ++batch.listCount;
+        }
+        prev->next = nullptr; // 断链
+        centralFreeList_[index].store(curr, std::memory_order_relaxed);
+        batch.list = head;
     }
 
-    /* prev 指向第 batchNum-1 个节点 */
-    BlockHeader* remain = curr; // 拆完剩余链
-    prev->next = nullptr;       // 断链
+    /* 2) 不足部分从未切分区间划出；一块都没拿到且区间已空时才补充 span */
+    std::size_t need = batchNum - batch.listCount;
+    if (need) {
+        if (batch.listCount == 0 && bumpCur_[index] == bumpEnd_[index]) refillFromPageCache(index);
 
-    centralFreeList_[index].store(remain, std::memory_order_relaxed);
+        std::size_t avail = static_cast<std::size_t>(bumpEnd_[index] - bumpCur_[index]) / blkBytes;
+        std::size_t take = need < avail ? need : avail;
+        batch.bumpBegin = bumpCur_[index];
+        batch.bumpEnd = bumpCur_[index] + take * blkBytes;
+        batch.bumpZeroed = bumpZeroed_[index];
+        bumpCur_[index] = batch.bumpEnd;
+    }
 
-    lk.unlock();
-    return head; // 返回批量链表
+    return batch;
 }
 
 void CentralCache::returnBatch(BlockHeader* start, std::size_t /*blockNum*/,
@@ -70,7 +138,7 @@ void CentralCache::returnBatch(BlockHeader* start, std::size_t /*blockNum*/,
     while (tail->next)
         tail = tail->next;
 
-    SpinLock& lk = locks_[index];
+    AdaptiveLock& lk = locks_[index];
     lk.lock();
 
     tail->next = centralFreeList_[index].load(std::memory_order_relaxed);
@@ -79,51 +147,163 @@ void CentralCache::returnBatch(BlockHeader* start, std::size_t /*blockNum*/,
     lk.unlock();
 }
 
-static constexpr std::size_t kSpanPagesForIndex(size_t index) {
-    size_t blockSize = (index + 1) * kAlignment;
-    size_t numPages = blockSize / kPageSize;
-    if (numPages <= 8) return 8;
-    return numPages;
+/* 预热：回收链与未切分区间合计不少于 count 块 */
+std::size_t CentralCache::reserve(std::size_t index, std::size_t count) {
+    assert(index < kFreeListNum && "size-class index out of range");
+
+    const std::size_t blkBytes = SizeClass::blockBytes(index);
+
+    std::lock_guard<AdaptiveLock> lg(locks_[index]);
+
+    /* 回收链只数到 count 为止 */
+    std::size_t have = 0;
+    for (BlockHeader* p = centralFreeList_[index].load(std::memory_order_relaxed); p && have < count;
+         p = p->next)
+        ++have;
+
+    /* 现有未切分区间：无人持有，可以安全地预先缺页 */
+    if (bumpCur_[index] != bumpEnd_[index]) {
+        PageCache::prefault(bumpCur_[index], bumpEnd_[index] - bumpCur_[index]);
+        have += static_cast<std::size_t>(bumpEnd_[index] - bumpCur_[index]) / blkBytes;
+    }
+
+    while (have < count) {
+        spillBumpToList(index);
+        if (!refillFromPageCache(index, /*populate=*/true)) break;
+        have += static_cast<std::size_t>(bumpEnd_[index] - bumpCur_[index]) / blkBytes;
+    }
+
+    return have;
 }
 
-/* 向 PageCache 申请，切分成 BlockHeader 链并挂入 centralFreeList_[index] */
-void CentralCache::refillFromPageCache(std::size_t index) {
-    size_t spanPages = kSpanPagesForIndex(index);
-    size_t spanBytes = spanPages * kPageSize;
+/* 剩余未切分块逐个写头部并挂入回收链 */
+void CentralCache::spillBumpToList(std::size_t index) {
+    const std::size_t blkBytes = SizeClass::blockBytes(index);
+    BlockHeader* head = centralFreeList_[index].load(std::memory_order_relaxed);
+    for (char* p = bumpCur_[index]; p != bumpEnd_[index]; p += blkBytes) {
+        auto* hd = reinterpret_cast<BlockHeader*>(p);
+        hd->size = SizeClass::userBytes(index);
+        hd->next = head;
+        head = hd;
+    }
+    centralFreeList_[index].store(head, std::memory_order_relaxed);
+    bumpCur_[index] = bumpEnd_[index];
+}
 
-    std::size_t userBytes = (index + 1) * kAlignment;
-    std::size_t blkBytes = userBytes + sizeof(BlockHeader); // 块总大小
+/* span 页数：至少 central.span_pages 页，大块按至少容纳 central.min_blocks_per_span 块向上取整 */
+static std::size_t spanPagesForIndex(std::size_t index) noexcept {
+    std::size_t blkBytes = SizeClass::blockBytes(index);
+    std::size_t numPages = (blkBytes * Options::minBlocksPerSpan() + kPageSize - 1) / kPageSize;
+    return std::max(numPages, Options::spanPages());
+}
 
-    if (blkBytes > spanBytes) return;
+/**
+ * 向 PageCache 申请 span，整段挂为 size-class 的未切分区间（不写任何块头）。
+ *
+ * 着色（Bonwick slab colouring）：span 按页对齐，若每个 span 都从页首切块，各 span 的
+ * 第一块落在同一组 L1 / L2 组相联集合上，逐个访问各 span 首块时互相驱逐。
+ * span 尾部本就有 spanBytes % blkBytes 字节的余量，把切块起点在余量内按 kColorAlign
+ * 轮转，块数不变，只是错开了各 span 的缓存集合。余量不足一个缓存行的类不着色。
+ */
+bool CentralCache::refillFromPageCache(std::size_t index, bool populate) {
+    size_t spanPages = spanPagesForIndex(index);
+    size_t spanBytes = spanPages * kPageSize;
+    std::size_t blkBytes = SizeClass::blockBytes(index); // 块总大小
 
     /* 向 PageCache 申请整页内存 */
-    void* spanMem = PageCache::getInstance().allocateSpan(spanPages); // 接口以页数为单位
-    if (!spanMem) return;                                              // 失败则放弃
-
-    /* 切分成链表，逆序插入头部 */
-    char* ptr = static_cast<char*>(spanMem);
-    std::size_t total = spanBytes / blkBytes;
-
-    /* 开始串链 */
-    BlockHeader* head = nullptr;
-    BlockHeader* tail = nullptr;
-    for (std::size_t i = 0; i < total; ++i) {
-        auto* hd = reinterpret_cast<BlockHeader*>(ptr);
-        hd->size = userBytes;
-        hd->next = nullptr;
-        if (!head) {
-            head = tail = hd;
-        } else {
-            tail->next = hd;
-            tail = hd;
+    bool zeroed = false;
+    void* spanMem = pageCache_.allocateSpan(spanPages, &zeroed, populate); // 接口以页数为单位
+    if (!spanMem) return false;                                            // 失败则放弃
+
+    /* 区间长度取块大小的整数倍，尾部不足一块的余量用作着色偏移 */
+    char* base = static_cast<char*>(spanMem);
+    std::size_t carveBytes = (spanBytes / blkBytes) * blkBytes;
+    std::size_t offset = 0;
+    if (Options::coloring()) {
+        std::size_t colors = (spanBytes - carveBytes) / kColorAlign + 1;
+        offset = (color_[index] % colors) * kColorAlign;
+        color_[index] = static_cast<std::uint16_t>(color_[index] % colors + 1);
+    }
+    bumpCur_[index] = base + offset;
+    bumpEnd_[index] = base + offset + carveBytes;
+    bumpZeroed_[index] = zeroed;
+    spans_[index].push_back({base, spanPages});
+    return true;
+}
+
+/* 回收：先请各线程收缩，再交还当前已全空的 span */
+void CentralCache::reclaim() {
+    trimEpoch_.fetch_add(1, std::memory_order_relaxed);
+    sweep();
+}
+
+void CentralCache::sweep() {
+    for (std::size_t i = 0; i < kFreeListNum; ++i) {
+        AdaptiveLock& lk = locks_[i];
+        if (!lk.try_lock()) continue;
+        if (!spans_[i].empty()) releaseFreeSpans(i);
+        lk.unlock();
+    }
+}
+
+/* 统计每个 span 中已回到中央的块（回收链 + 未切分区间），全空的 span 摘链后交还 */
+std::size_t CentralCache::releaseFreeSpans(std::size_t index) {
+    BlockHeader* head = centralFreeList_[index].load(std::memory_order_relaxed);
+    auto& spans = spans_[index];
+    if (!head && bumpCur_[index] == bumpEnd_[index]) return 0;
+
+    const std::size_t blkBytes = SizeClass::blockBytes(index);
+    std::sort(spans.begin(), spans.end(),
+              [](const SpanRecord& a, const SpanRecord& b) { return a.base < b.base; });
+
+    /* 地址 → 所在 span 的下标 */
+    auto spanOf = [&](const char* p) {
+        auto it = std::upper_bound(spans.begin(), spans.end(), p,
+                                   [](const char* x, const SpanRecord& s) { return x < s.base; });
+        return static_cast<std::size_t>(it - spans.begin()) - 1;
+    };
+
+    std::vector<std::size_t> freeCnt(spans.size(), 0);
+    for (BlockHeader* p = head; p; p = p->next)
+        ++freeCnt[spanOf(reinterpret_cast<char*>(p))];
+    if (bumpCur_[index] != bumpEnd_[index])
+        freeCnt[spanOf(bumpCur_[index])] +=
+            static_cast<std::size_t>(bumpEnd_[index] - bumpCur_[index]) / blkBytes;
+
+    std::vector<bool> whole(spans.size(), false);
+    bool any = false;
+    for (std::size_t k = 0; k < spans.size(); ++k) {
+        whole[k] = freeCnt[k] == spans[k].pages * kPageSize / blkBytes;
+        any = any || whole[k];
+    }
+    if (!any) return 0;
+
+    /* 回收链中剔除属于全空 span 的块 */
+    BlockHeader* kept = nullptr;
+    for (BlockHeader* p = head; p;) {
+        BlockHeader* nxt = p->next;
+        if (!whole[spanOf(reinterpret_cast<char*>(p))]) {
+            p->next = kept;
+            kept = p;
         }
-        ptr += blkBytes;
+        p = nxt;
     }
+    centralFreeList_[index].store(kept, std::memory_order_relaxed);
+    if (bumpCur_[index] != bumpEnd_[index] && whole[spanOf(bumpCur_[index])])
+        bumpCur_[index] = bumpEnd_[index] = nullptr;
 
-    /* 挂到 freelist 头部 */
-    BlockHeader* oldHead = centralFreeList_[index].load(std::memory_order_relaxed);
-    tail->next = oldHead;
-    centralFreeList_[index].store(head, std::memory_order_relaxed);
+    /* 交还并从登记表删除 */
+    std::size_t released = 0, out = 0;
+    for (std::size_t k = 0; k < spans.size(); ++k) {
+        if (whole[k]) {
+            pageCache_.freeSpan(spans[k].base, spans[k].pages);
+            released += spans[k].pages;
+        } else {
+            spans[out++] = spans[k];
+        }
+    }
+    spans.resize(out);
+    return released;
 }
 
 } // namespace mempool
@@ -0,0 +1,27 @@
+#include "Coroutine.h"
+
+namespace mempool
+{
+
+/* thread_local 按构造完成的逆序析构：ThreadCache 先于本缓存构造，本缓存析构时它仍然有效，
+   交回的帧随后在 ~ThreadCache 的 flush 中回到 CentralCache */
+FrameCache* FrameCache::initSlow() {
+    if (destroyed_ || !ThreadCache::current()) return nullptr;
+    thread_local FrameCache fc;
+    tls_ = &fc;
+    return &fc;
+}
+
+FrameCache::~FrameCache() {
+    tls_ = nullptr;
+    destroyed_ = true;
+    for (auto& s : slots_) {
+        while (void* p = s.head) {
+            s.head = *static_cast<void**>(p);
+            MemoryPool::deallocate(p, s.size);
+        }
+        s.count = 0;
+    }
+}
+
+} // namespace mempool
@@ -0,0 +1,96 @@
+#include "Epoch.h"
+
+#include <mutex>
+#include <vector>
+
+namespace mempool
+{
+namespace
+{
+
+/* 孤儿表：已退出线程留下的退休链及其退休纪元 */
+struct OrphanBag {
+    BlockHeader* head;
+    std::uint64_t epoch;
+};
+
+std::mutex orphanMutex;
+std::vector<OrphanBag> orphans;
+
+} // namespace
+
+/* 先找已退出线程留下的记录，没有再新建并挂到表头 */
+EpochRecord* Epoch::acquire() {
+    for (EpochRecord* r = records_.load(std::memory_order_acquire); r; r = r->next) {
+        bool expected = false;
+        if (!r->inUse.load(std::memory_order_relaxed) &&
+            r->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            return r;
+    }
+
+    auto* r = new EpochRecord;
+    r->inUse.store(true, std::memory_order_relaxed);
+    EpochRecord* head = records_.load(std::memory_order_relaxed);
+    do {
+        r->next = head;
+    } while (!records_.compare_exchange_weak(head, r, std::memory_order_release, std::memory_order_relaxed));
+    return r;
+}
+
+void Epoch::release(EpochRecord* rec) noexcept {
+    rec->pinned.store(0, std::memory_order_release);
+    rec->inUse.store(false, std::memory_order_release);
+}
+
+/**
+ * 推进：读全局纪元 e，扫描所有记录，处于临界区的都已是 e 才把 e 换成 e + 1。
+ * 前面的全屏障与读者进入临界区时的全屏障配对：扫描看不到的读者，
+ * 其后续读取一定晚于此处，已经找不到在 e - 1 及更早退休的块。
+ */
+bool Epoch::tryAdvance() noexcept {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::uint64_t e = global_.load(std::memory_order_relaxed);
+
+    for (EpochRecord* r = records_.load(std::memory_order_acquire); r; r = r->next) {
+        std::uint64_t p = r->pinned.load(std::memory_order_acquire); // 与 unpin 的 release 配对
+        if (p != 0 && p != e) return false;
+    }
+
+    return global_.compare_exchange_strong(e, e + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+void Epoch::orphan(BlockHeader* head, std::uint64_t epoch) {
+    if (!head) return;
+    std::lock_guard<std::mutex> lg(orphanMutex);
+    orphans.push_back({head, epoch});
+    hasOrphans_.store(true, std::memory_order_release);
+}
+
+/* 只 try_lock：孤儿表在每次批量回收时顺带检查，忙则留给下一次 */
+BlockHeader* Epoch::adoptOrphans() {
+    if (!hasOrphans_.load(std::memory_order_acquire)) return nullptr;
+
+    std::unique_lock<std::mutex> lk(orphanMutex, std::try_to_lock);
+    if (!lk.owns_lock()) return nullptr;
+
+    const std::uint64_t e = global();
+    BlockHeader* out = nullptr;
+    std::size_t kept = 0;
+    for (auto& bag : orphans) {
+        if (bag.epoch + kGracePeriods > e) {
+            orphans[kept++] = bag;
+            continue;
+        }
+        /* 整条链接到输出前面 */
+        BlockHeader* tail = bag.head;
+        while (tail->next)
+            tail = tail->next;
+        tail->next = out;
+        out = bag.head;
+    }
+    orphans.resize(kept);
+    hasOrphans_.store(kept != 0, std::memory_order_relaxed);
+    return out;
+}
+
+} // namespace mempool
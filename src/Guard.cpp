@@ -0,0 +1,260 @@
+#include "Guard.h"
+
+#include <algorithm> // std::min
+#include <cstdarg>
+#include <cstdio>  // std::vsnprintf
+#include <cstdlib> // std::abort
+#include <cstring> // std::memcpy
+#include <mutex>
+
+#include <execinfo.h>    // backtrace / backtrace_symbols_fd
+#include <signal.h>      // sigaction
+#include <sys/mman.h>    // mmap / mprotect / madvise
+#include <sys/syscall.h> // SYS_gettid
+#include <unistd.h>      // write / syscall
+
+#include "Options.h"
+
+namespace mempool
+{
+namespace
+{
+
+constexpr std::size_t kSlotBytes = 2 * kPageSize; // 数据页 + 守护页
+
+enum class SlotState : std::uint8_t { Unused, Live, Freed };
+
+/** 槽位元数据：只在槽位锁内写，故障处理器不加锁读取 */
+struct SlotInfo {
+    std::uintptr_t user; // 用户指针
+    std::size_t size;    // 用户字节数（按 kAlignment 取整）
+    SlotState state;
+    int allocTid;
+    int freeTid;
+    int allocDepth;
+    int freeDepth;
+    void* allocTrace[Guard::kMaxFrames];
+    void* freeTrace[Guard::kMaxFrames];
+};
+
+/** 槽位区：槽位页、元数据与空闲队列（环形 FIFO，释放的槽位排到队尾） */
+struct Region {
+    std::mutex mutex;
+    char* base{nullptr};
+    std::size_t count{0};
+    SlotInfo* info{nullptr};
+    std::uint32_t* queue{nullptr};
+    std::size_t queueHead{0};
+    std::size_t queueSize{0};
+    GuardStats stats;
+    struct sigaction prevAction {};
+} region;
+
+int threadId() noexcept { return static_cast<int>(::syscall(SYS_gettid)); }
+
+/* 故障处理器中也会调用：格式化到栈上缓冲区后直接 write(2)，不分配内存 */
+void say(const char* fmt, ...) noexcept {
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = std::vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0) (void)!::write(STDERR_FILENO, buf, std::min<std::size_t>(n, sizeof(buf) - 1));
+}
+
+/* 报告：故障类型、相对块的位置、分配 / 释放调用栈 */
+void report(const char* kind, std::uintptr_t addr, const SlotInfo& s) noexcept {
+    say("mempool: guard-page %s at %p (thread %d)\n", kind, reinterpret_cast<void*>(addr), threadId());
+    if (s.state == SlotState::Unused) return;
+
+    const char* where;
+    std::size_t dist;
+    if (addr >= s.user + s.size) {
+        where = "after";
+        dist = addr - (s.user + s.size);
+    } else if (addr < s.user) {
+        where = "before";
+        dist = s.user - addr;
+    } else {
+        where = "inside";
+        dist = addr - s.user;
+    }
+    say("mempool: address is %zu bytes %s the %zu-byte block at %p\n", dist, where, s.size,
+        reinterpret_cast<void*>(s.user));
+
+    say("mempool: allocated by thread %d:\n", s.allocTid);
+    ::backtrace_symbols_fd(s.allocTrace, s.allocDepth, STDERR_FILENO);
+    if (s.state == SlotState::Freed) {
+        say("mempool: freed by thread %d:\n", s.freeTid);
+        ::backtrace_symbols_fd(s.freeTrace, s.freeDepth, STDERR_FILENO);
+    }
+}
+
+/* 落在槽位区的故障：按槽位状态与页内位置分类 */
+void reportFault(std::uintptr_t addr) noexcept {
+    std::size_t off = addr - reinterpret_cast<std::uintptr_t>(region.base);
+    const SlotInfo& s = region.info[off / kSlotBytes];
+
+    const char* kind;
+    if (s.state == SlotState::Unused)
+        kind = "wild-access";
+    else if (off % kSlotBytes >= kPageSize)
+        kind = "buffer-overflow";
+    else if (addr < s.user && addr >= s.user - sizeof(BlockHeader))
+        kind = "double-free"; // 释放路径读取已释放块的块头
+    else
+        kind = "use-after-free";
+    report(kind, addr, s);
+}
+
+void onFault(int sig, siginfo_t* info, void* uctx) {
+    const struct sigaction& prev = region.prevAction;
+    if (Guard::owns(info->si_addr)) {
+        reportFault(reinterpret_cast<std::uintptr_t>(info->si_addr));
+        /* 恢复之前的处理方式后返回：重新执行的访问再次故障，按原方式终止（默认 core dump） */
+        ::sigaction(SIGSEGV, &prev, nullptr);
+        return;
+    }
+
+    /* 不是守护页故障：交给之前的处理器 */
+    if (prev.sa_flags & SA_SIGINFO) {
+        if (prev.sa_sigaction) prev.sa_sigaction(sig, info, uctx);
+    } else if (prev.sa_handler != SIG_DFL && prev.sa_handler != SIG_IGN) {
+        prev.sa_handler(sig);
+    } else {
+        ::sigaction(SIGSEGV, &prev, nullptr);
+    }
+}
+
+} // namespace
+
+/* xorshift64：只在采样慢路径上调用，随机性够用即可 */
+std::uint32_t Guard::nextInterval() noexcept {
+    std::size_t rate = Options::guardSampleRate();
+    if (!rate) return kDisabledInterval;
+    if (rate == 1) return 1;
+
+    thread_local std::uint64_t rng = 0;
+    if (!rng) rng = (reinterpret_cast<std::uintptr_t>(&rng) ^ std::uint64_t(threadId())) * 0x9E3779B97F4A7C15ull | 1;
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return static_cast<std::uint32_t>(1 + rng % (2 * rate - 1));
+}
+
+bool Guard::initRegion() noexcept {
+    if (region.base) return true;
+
+    std::size_t n = Options::guardSlots();
+    void* slots = ::mmap(nullptr, n * kSlotBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (slots == MAP_FAILED) return false;
+
+    /* 元数据与空闲队列放在同一段匿名映射中；全零即 SlotState::Unused */
+    std::size_t metaBytes = n * (sizeof(SlotInfo) + sizeof(std::uint32_t));
+    void* meta = ::mmap(nullptr, metaBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (meta == MAP_FAILED) {
+        ::munmap(slots, n * kSlotBytes);
+        return false;
+    }
+
+    region.info = static_cast<SlotInfo*>(meta);
+    region.queue = reinterpret_cast<std::uint32_t*>(region.info + n);
+    for (std::size_t i = 0; i < n; ++i)
+        region.queue[i] = static_cast<std::uint32_t>(i);
+    region.queueHead = 0;
+    region.queueSize = n;
+    region.count = n;
+    region.stats.slots = n;
+
+    struct sigaction sa {};
+    sa.sa_sigaction = onFault;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+    ::sigaction(SIGSEGV, &sa, &region.prevAction);
+
+    region.base = static_cast<char*>(slots);
+    begin_.store(reinterpret_cast<std::uintptr_t>(slots), std::memory_order_relaxed);
+    end_.store(reinterpret_cast<std::uintptr_t>(slots) + n * kSlotBytes, std::memory_order_relaxed);
+    return true;
+}
+
+void* Guard::allocate(std::size_t size) noexcept {
+    if (size == 0) size = kAlignment;
+    if (size > kMaxGuardedBytes) return nullptr;
+    const std::size_t bytes = SizeClass::roundUp(size);
+
+    /* 调用栈在锁外抓取（首次调用会载入 libgcc） */
+    void* trace[kMaxFrames];
+    int depth = ::backtrace(trace, kMaxFrames);
+
+    std::lock_guard<std::mutex> lg(region.mutex);
+    if (!initRegion()) return nullptr;
+    if (!region.queueSize) {
+        ++region.stats.exhausted;
+        return nullptr;
+    }
+
+    std::uint32_t i = region.queue[region.queueHead];
+    char* page = region.base + i * kSlotBytes;
+    if (::mprotect(page, kPageSize, PROT_READ | PROT_WRITE) != 0) return nullptr;
+    region.queueHead = (region.queueHead + 1) % region.count;
+    --region.queueSize;
+
+    /* 块尾紧贴守护页 */
+    char* user = page + kPageSize - bytes;
+    auto* hd = reinterpret_cast<BlockHeader*>(user) - 1;
+    hd->size = bytes | kGuardedFlag;
+    hd->next = nullptr;
+
+    SlotInfo& s = region.info[i];
+    s.user = reinterpret_cast<std::uintptr_t>(user);
+    s.size = bytes;
+    s.state = SlotState::Live;
+    s.allocTid = threadId();
+    s.allocDepth = depth;
+    std::memcpy(s.allocTrace, trace, sizeof(void*) * depth);
+    s.freeTid = 0;
+    s.freeDepth = 0;
+
+    ++region.stats.sampled;
+    ++region.stats.live;
+    return user;
+}
+
+void Guard::deallocate(void* ptr) noexcept {
+    void* trace[kMaxFrames];
+    int depth = ::backtrace(trace, kMaxFrames);
+    auto addr = reinterpret_cast<std::uintptr_t>(ptr);
+
+    std::lock_guard<std::mutex> lg(region.mutex);
+    std::size_t i = (addr - reinterpret_cast<std::uintptr_t>(region.base)) / kSlotBytes;
+    SlotInfo& s = region.info[i];
+    if (s.state != SlotState::Live || s.user != addr) {
+        report("invalid-free", addr, s);
+        say("mempool: freed by thread %d:\n", threadId());
+        ::backtrace_symbols_fd(trace, depth, STDERR_FILENO);
+        std::abort();
+    }
+
+    /* 整页收回：内容交还内核，之后的任何访问都会故障 */
+    char* page = region.base + i * kSlotBytes;
+    ::madvise(page, kPageSize, MADV_DONTNEED);
+    ::mprotect(page, kPageSize, PROT_NONE);
+
+    s.state = SlotState::Freed;
+    s.freeTid = threadId();
+    s.freeDepth = depth;
+    std::memcpy(s.freeTrace, trace, sizeof(void*) * depth);
+
+    /* 排到空闲队列尾部：其它空闲槽位都用过之后才会复用（隔离） */
+    region.queue[(region.queueHead + region.queueSize) % region.count] = static_cast<std::uint32_t>(i);
+    ++region.queueSize;
+    --region.stats.live;
+}
+
+GuardStats Guard::stats() {
+    std::lock_guard<std::mutex> lg(region.mutex);
+    return region.stats;
+}
+
+} // namespace mempool
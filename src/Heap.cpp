@@ -0,0 +1,112 @@
+#include "Heap.h"
+
+#include <atomic>
+#include <bitset>
+#include <mutex>
+#include <new> // std::bad_alloc
+
+namespace mempool
+{
+namespace
+{
+
+/* 槽位分配：存活堆占用的槽位；liveHeapId 记录槽位上仍可接收归还的堆编号（0 为已开始析构） */
+std::mutex slotMutex;
+std::bitset<Heap::kMaxHeaps> slotUsed;
+std::array<std::uint64_t, Heap::kMaxHeaps> liveHeapId{};
+
+/* 堆编号从 1 开始，0 表示槽位上没有缓存 */
+std::atomic<std::uint64_t> nextHeapId{1};
+
+/* 大对象占用的页数（含头部） */
+inline std::size_t largePages(std::size_t size) noexcept {
+    return (size + sizeof(BlockHeader) + kPageSize - 1) / kPageSize;
+}
+
+} // namespace
+
+thread_local Heap::LocalCaches Heap::localCaches_;
+
+/* 线程退出：所属堆仍存活的缓存先把空闲链交还该堆的 CentralCache，否则其中的块要等到堆析构才回收。
+   持锁期间堆不会开始析构 */
+Heap::LocalCaches::~LocalCaches() {
+    std::lock_guard<std::mutex> lg(slotMutex);
+    for (std::size_t s = 0; s < kMaxHeaps; ++s) {
+        Entry& e = slots[s];
+        if (e.cache && e.heapId == liveHeapId[s]) e.cache->flush();
+        delete e.cache;
+        e = {};
+    }
+}
+
+Heap::Heap() : id_(nextHeapId.fetch_add(1, std::memory_order_relaxed)) {
+    {
+        std::lock_guard<std::mutex> lg(slotMutex);
+        std::size_t s = 0;
+        while (s < kMaxHeaps && slotUsed[s])
+            ++s;
+        if (s == kMaxHeaps) throw std::bad_alloc();
+        slotUsed[s] = true;
+        liveHeapId[s] = id_;
+        slot_ = s;
+    }
+    pageCache_ = new PageCache();
+    central_ = new CentralCache(*pageCache_);
+}
+
+Heap::~Heap() {
+    /* 此后退出的线程不再向本堆归还 */
+    {
+        std::lock_guard<std::mutex> lg(slotMutex);
+        liveHeapId[slot_] = 0;
+    }
+
+    /* 本线程的缓存立即丢弃；其它线程的在槽位复用或线程退出时丢弃 */
+    auto& e = localCaches_.slots[slot_];
+    if (e.heapId == id_) {
+        delete e.cache;
+        e = {};
+    }
+
+    delete central_;
+    delete pageCache_; // 整段 munmap 本堆的所有系统区间
+
+    std::lock_guard<std::mutex> lg(slotMutex);
+    slotUsed[slot_] = false;
+}
+
+ThreadCache& Heap::localCache() {
+    auto& e = localCaches_.slots[slot_];
+    if (e.heapId != id_) [[unlikely]] {
+        delete e.cache; // 槽位上一任主人已销毁，缓存内容全部作废，无需逐块处理
+        e.cache = new ThreadCache(*central_);
+        e.heapId = id_;
+    }
+    return *e.cache;
+}
+
+void* Heap::allocate(std::size_t size) {
+    /* 大对象：按页从本堆 PageCache 申请，随堆一起销毁 */
+    if (size > kMaxBytes) {
+        auto* hd = static_cast<BlockHeader*>(pageCache_->allocateSpan(largePages(size)));
+        hd->size = size;
+        hd->next = nullptr;
+        return hd + 1;
+    }
+    return localCache().allocate(size);
+}
+
+void Heap::deallocate(void* ptr) {
+    if (!ptr) return;
+
+    auto* hd = reinterpret_cast<BlockHeader*>(ptr) - 1;
+    if (hd->size > kMaxBytes) {
+        pageCache_->freeSpan(hd, largePages(hd->size));
+        return;
+    }
+    localCache().deallocate(ptr);
+}
+
+bool Heap::owns(const void* ptr) const noexcept { return ptr && pageCache_->owns(ptr); }
+
+} // namespace mempool
@@ -0,0 +1,155 @@
+#include "Options.h"
+
+#include <cstdio>  // std::fprintf
+#include <cstdlib> // std::getenv / std::strtoull
+#include <cstring> // std::strncmp / std::strlen
+
+namespace mempool
+{
+namespace
+{
+
+constexpr char kBatchPrefix[] = "tcache.batch.";
+constexpr std::size_t kBatchPrefixLen = sizeof(kBatchPrefix) - 1;
+
+/* 解析十进制无符号整数，必须整串都是数字 */
+bool parseSize(const char* s, std::size_t len, std::size_t& out) noexcept {
+    if (len == 0) return false;
+    std::size_t v = 0;
+    for (std::size_t i = 0; i < len; ++i) {
+        if (s[i] < '0' || s[i] > '9') return false;
+        if (__builtin_mul_overflow(v, 10, &v) || __builtin_add_overflow(v, std::size_t(s[i] - '0'), &v))
+            return false;
+    }
+    out = v;
+    return true;
+}
+
+/* "tcache.batch.<bytes>" → size-class 下标；不是此形式返回 false */
+bool batchIndex(const char* name, std::size_t& index) noexcept {
+    if (std::strncmp(name, kBatchPrefix, kBatchPrefixLen) != 0) return false;
+    std::size_t bytes;
+    const char* num = name + kBatchPrefixLen;
+    if (!parseSize(num, std::strlen(num), bytes) || bytes == 0 || bytes > kMaxBytes) return false;
+    index = SizeClass::getIndex(bytes);
+    return true;
+}
+
+/* 启动时读取 MEMPOOL_OPTIONS */
+struct EnvOptions {
+    EnvOptions() {
+        if (const char* spec = std::getenv("MEMPOOL_OPTIONS")) Options::parse(spec);
+    }
+} envOptions;
+
+} // namespace
+
+bool Options::set(const char* name, std::size_t value) noexcept {
+    if (!name) return false;
+
+    std::size_t index;
+    if (batchIndex(name, index)) {
+        if (value > kMaxBatch) return false;
+        batch_[index].store(static_cast<std::uint16_t>(value), std::memory_order_relaxed);
+        generation_.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+
+    if (!std::strcmp(name, "tcache.max_bytes")) {
+        tcacheMaxBytes_.store(value, std::memory_order_relaxed);
+    } else if (!std::strcmp(name, "tcache.list_factor")) {
+        if (value == 0) return false;
+        tcacheListFactor_.store(value, std::memory_order_relaxed);
+    } else if (!std::strcmp(name, "central.span_pages")) {
+        if (value == 0 || value > kMaxSpanPages) return false;
+        spanPages_.store(value, std::memory_order_relaxed);
+    } else if (!std::strcmp(name, "central.min_blocks_per_span")) {
+        if (value == 0) return false;
+        minBlocksPerSpan_.store(value, std::memory_order_relaxed);
+    } else if (!std::strcmp(name, "central.coloring")) {
+        if (value > 1) return false;
+        coloring_.store(value, std::memory_order_relaxed);
+    } else if (!std::strcmp(name, "page.release_threshold")) {
+        releaseThresholdPages_.store(value, std::memory_order_relaxed);
+    } else if (!std::strcmp(name, "limit.soft_bytes")) {
+        softLimitBytes_.store(value, std::memory_order_relaxed);
+    } else if (!std::strcmp(name, "limit.hard_bytes")) {
+        hardLimitBytes_.store(value, std::memory_order_relaxed);
+    } else if (!std::strcmp(name, "guard.sample_rate")) {
+        if (value > kMaxGuardSampleRate) return false;
+        guardSampleRate_.store(value, std::memory_order_relaxed);
+    } else if (!std::strcmp(name, "guard.slots")) {
+        if (value == 0 || value > kMaxGuardSlots) return false;
+        guardSlots_.store(value, std::memory_order_relaxed);
+    } else {
+        return false;
+    }
+    generation_.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool Options::get(const char* name, std::size_t& value) noexcept {
+    if (!name) return false;
+
+    std::size_t index;
+    if (batchIndex(name, index)) {
+        value = batchOverride(index);
+        return true;
+    }
+
+    if (!std::strcmp(name, "tcache.max_bytes"))
+        value = tcacheMaxBytes();
+    else if (!std::strcmp(name, "tcache.list_factor"))
+        value = tcacheListFactor();
+    else if (!std::strcmp(name, "central.span_pages"))
+        value = spanPages();
+    else if (!std::strcmp(name, "central.min_blocks_per_span"))
+        value = minBlocksPerSpan();
+    else if (!std::strcmp(name, "central.coloring"))
+        value = coloring();
+    else if (!std::strcmp(name, "page.release_threshold"))
+        value = releaseThresholdPages();
+    else if (!std::strcmp(name, "limit.soft_bytes"))
+        value = softLimitBytes();
+    else if (!std::strcmp(name, "limit.hard_bytes"))
+        value = hardLimitBytes();
+    else if (!std::strcmp(name, "guard.sample_rate"))
+        value = guardSampleRate();
+    else if (!std::strcmp(name, "guard.slots"))
+        value = guardSlots();
+    else
+        return false;
+    return true;
+}
+
+std::size_t Options::parse(const char* spec) noexcept {
+    if (!spec) return 0;
+
+    std::size_t applied = 0;
+    while (*spec) {
+        const char* end = std::strchr(spec, ',');
+        std::size_t len = end ? static_cast<std::size_t>(end - spec) : std::strlen(spec);
+
+        /* name=value；名字长度受限于本地缓冲 */
+        const char* eq = static_cast<const char*>(std::memchr(spec, '=', len));
+        char name[64];
+        std::size_t nameLen = eq ? static_cast<std::size_t>(eq - spec) : 0;
+        std::size_t value;
+        if (eq && nameLen > 0 && nameLen < sizeof(name) && parseSize(eq + 1, len - nameLen - 1, value)) {
+            std::memcpy(name, spec, nameLen);
+            name[nameLen] = '\0';
+            if (set(name, value))
+                ++applied;
+            else
+                std::fprintf(stderr, "mempool: invalid option %s=%zu\n", name, value);
+        } else if (len > 0) {
+            std::fprintf(stderr, "mempool: cannot parse option '%.*s'\n", static_cast<int>(len), spec);
+        }
+
+        if (!end) break;
+        spec = end + 1;
+    }
+    return applied;
+}
+
+} // namespace mempool
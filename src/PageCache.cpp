@@ -4,10 +4,12 @@
 #include <cstring>  // std::memset
 #include <iostream> // 可选：调试日志
 
+#include <sys/mman.h> // mmap / munmap / madvise
+
+#include "Options.h" // page.release_threshold
+
 namespace mempool
 {
-/* 静态成员唯一定义 */
-std::unordered_set<void*> PageCache::systemBases_;
 
 /* 构成单例 */
 PageCache& PageCache::getInstance() {
@@ -15,84 +17,288 @@ PageCache& PageCache::getInstance() {
     return pc;
 }
 
-/* 从操作系统请求整段页内存（对齐到页大小） */
-void* PageCache::systemAllocPages(std::size_t numPages) {
+PageCache::PageCache() {
+    for (auto& sh : shards_)
+        sh.pageMap_ = &pageMap_;
+}
+
+/* ~PageCache */
+PageCache::~PageCache() {
+    for (auto& sh : shards_)
+        sh.releaseAll();
+}
+
+/* 从操作系统请求整段页内存：匿名映射按页对齐，且内核保证内容全零 */
+void* PageCache::systemAllocPages(std::size_t numPages, bool populate) {
     std::size_t bytes = numPages * kPageSize;
-    /* C++ 11 所有平台的统一接口 */
-    void* ptr = ::operator new(bytes, std::align_val_t{kPageSize}, std::nothrow);
-    if (!ptr) throw std::bad_alloc();
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | (populate ? MAP_POPULATE : 0);
+    void* ptr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+/* 把系统基址还给操作系统 */
+void PageCache::systemFreePages(void* base, std::size_t numPages) {
+    ::munmap(base, numPages * kPageSize);
+}
+
+/* 预先缺页：内核支持时一次 madvise 完成，否则逐页“读出再写回原值” */
+void PageCache::prefault(void* addr, std::size_t bytes) noexcept {
+    if (!addr || bytes == 0) return;
+    auto b = reinterpret_cast<std::uintptr_t>(addr);
+    auto e = b + bytes;
 
-    systemBases_.insert(ptr);
-    return ptr;
+#ifdef MADV_POPULATE_WRITE
+    std::uintptr_t pb = b & ~(kPageSize - 1);
+    std::uintptr_t pe = (e + kPageSize - 1) & ~(kPageSize - 1);
+    if (::madvise(reinterpret_cast<void*>(pb), pe - pb, MADV_POPULATE_WRITE) == 0) return;
+#endif
+
+    /* 只碰区间内的字节：首字节与其后每个页首，写回原值不改变内容（全零仍为全零） */
+    for (std::uintptr_t p = b; p < e; p = (p & ~(kPageSize - 1)) + kPageSize) {
+        volatile char* c = reinterpret_cast<volatile char*>(p);
+        *c = *c;
+    }
+}
+
+/* 当前线程的主分片：线程首次使用时轮转分配，之后固定 */
+PageCache::Shard& PageCache::homeShard() noexcept {
+    static std::atomic<std::size_t> nextShard{0};
+    thread_local std::size_t home = nextShard.fetch_add(1, std::memory_order_relaxed) % kShardNum;
+    return shards_[home];
+}
+
+/* addr 所属分片 */
+PageCache::Shard* PageCache::ownerOf(void* addr) noexcept {
+    std::uint8_t id = pageMap_.get(addr);
+    return id ? &shards_[id - 1] : nullptr;
 }
 
 /* 分配 numPages 个连续页，返回首地址（对齐至 kPageSize） */
-void* PageCache::allocateSpan(std::size_t numPages) {
+void* PageCache::allocateSpan(std::size_t numPages, bool* zeroed, bool populate) {
     if (numPages == 0) numPages = 1;
 
-    std::lock_guard<std::mutex> lg(mutex_);
+    Shard& sh = homeShard();
+    bool zero = false;
 
-    /* 找第一个 >= numPages 的空闲 span */
-    auto it = freeSpans_.lower_bound(numPages);
-    /* 找得到的话 */
-    if (it != freeSpans_.end()) {
-        Span* span = it->second;
-        assert(span && span->numPages >= numPages);
-
-        /* 精确匹配 —— 直接取整段 */
-        if (span->numPages == numPages) {
-            void* addr = span->pageAddr;
-            eraseSpan(span);
-            totalFreePages_ -= numPages;
-            activeSpans_.emplace(addr, numPages);
+    /* 1) 无锁快速路径：恰好 numPages 页的缓存 span（由使用者直接归还，内容未知） */
+    if (numPages <= kFastSpanMaxPages)
+        if (void* addr = sh.popFast(numPages)) {
+            if (zeroed) *zeroed = false;
+            if (populate) prefault(addr, numPages * kPageSize);
             return addr;
         }
 
-        /* 较大 span —— 拆分：前半返回，后半继续留在空闲表 */
-        void* addr = span->pageAddr;
-        std::size_t remainPages = span->numPages - numPages;
-        void* remainAddr = static_cast<char*>(span->pageAddr) + numPages * kPageSize;
+    /* 2) 分片空闲表；不够时先把槽位中的零散 span 合并回来再试一次 */
+    void* addr = nullptr;
+    {
+        std::lock_guard<std::mutex> lg(sh.mutex_);
+        addr = sh.takeFromFreeLists(numPages, zero);
+        if (!addr && sh.drainFast()) addr = sh.takeFromFreeLists(numPages, zero);
+    }
+    if (addr) {
+        if (zeroed) *zeroed = zero;
+        if (populate) prefault(addr, numPages * kPageSize); // 锁外缺页
+        return addr;
+    }
 
-        span->pageAddr = remainAddr;
-        span->numPages = remainPages;
+    /* 3) 向系统申请：在锁外进行，受软 / 硬上限约束 */
+    addr = allocateFromSystem(sh, numPages, populate, zero);
+    if (zeroed) *zeroed = zero;
+    return addr;
+}
 
-        /* 更新 size-map：先删再插入新的 key */
-        freeSpans_.erase(it);
-        freeSpans_.emplace(remainPages, span);
+/* 向系统申请 numPages 页并登记到 sh；超过硬上限或 mmap 失败时先回收，再交给 OOM 处理器 */
+void* PageCache::allocateFromSystem(Shard& sh, std::size_t numPages, bool populate, bool& zeroed) {
+    const std::size_t bytes = numPages * kPageSize;
+    bool reclaimed = false;
+    void* addr = nullptr;
+
+    for (;;) {
+        std::size_t hard = Options::hardLimitBytes();
+        if (!hard || systemPages() * kPageSize + bytes <= hard) {
+            addr = systemAllocPages(numPages, populate);
+            if (addr) break;
+        }
 
-        /* 更新 addr-map：重新定位键 */
-        addrSpanMap_.erase(addr);
-        addrSpanMap_.emplace(remainAddr, span);
+        /* 先回收一次：回收出的 span 可能直接满足本次申请 */
+        if (!reclaimed) {
+            reclaim();
+            reclaimed = true;
+            {
+                std::lock_guard<std::mutex> lg(sh.mutex_);
+                addr = sh.takeFromFreeLists(numPages, zeroed);
+            }
+            if (addr) {
+                if (populate) prefault(addr, bytes);
+                return addr;
+            }
+            continue;
+        }
 
-        totalFreePages_ -= numPages;
-        activeSpans_.emplace(addr, numPages);
+        /* 回收后仍不够：交给用户处理器，返回 true 表示已腾出内存，重新来过 */
+        OomHandler handler = oomHandler_.load(std::memory_order_acquire);
+        if (!handler || !handler(bytes)) throw std::bad_alloc();
+        reclaimed = false;
+    }
 
-        return addr;
+    zeroed = true;
+    pageMap_.set(addr, numPages, static_cast<std::uint8_t>(&sh - shards_.data() + 1));
+    {
+        std::lock_guard<std::mutex> lg(sh.mutex_);
+        sh.systemBases_.emplace(addr, numPages);
     }
+    sh.systemPages_.fetch_add(numPages, std::memory_order_relaxed);
 
-    void* addr = systemAllocPages(numPages);
-    activeSpans_.emplace(addr, numPages);
+    /* 越过软上限：每次越线只主动回收一次，之后靠归还路径立即释放 */
+    if (overSoftLimit() && !softReclaimed_.exchange(true, std::memory_order_relaxed)) reclaim();
     return addr;
 }
 
+bool PageCache::overSoftLimit() const noexcept {
+    std::size_t soft = Options::softLimitBytes();
+    return soft && systemPages() * kPageSize > soft;
+}
+
+/* 常态下为 page.release_threshold 的分片均摊值；超过软上限时为 0 */
+std::size_t PageCache::releaseThreshold() noexcept {
+    if (overSoftLimit()) return 0;
+    softReclaimed_.store(false, std::memory_order_relaxed);
+    return Options::releaseThresholdPages() / kShardNum;
+}
+
+/* 回收：上层先交回整段空闲的 span，再逐分片归还系统 */
+void PageCache::reclaim() {
+    if (reclaimFn_) reclaimFn_(reclaimCtx_);
+    for (auto& sh : shards_) {
+        std::lock_guard<std::mutex> lg(sh.mutex_);
+        sh.trim();
+    }
+}
+
 /* 归还 span */
 void PageCache::freeSpan(void* addr, std::size_t numPages) {
     if (!addr || numPages == 0) return;
 
-    std::lock_guard<std::mutex> lg(mutex_);
+    /* 只接受本 PageCache 借出的地址，交还给其所属分片 */
+    Shard* sh = ownerOf(addr);
+    if (!sh) return;
+
+    if (numPages <= kFastSpanMaxPages && sh->pushFast(addr, numPages)) return;
 
-    // 将 span 从活跃表移除（若重复 free 会自动忽略）
-    activeSpans_.erase(addr);
+    /* 大 span：锁外交还物理页，之后内容即为全零 */
+    bool zero = numPages >= kDontNeedMinPages &&
+                ::madvise(addr, numPages * kPageSize, MADV_DONTNEED) == 0;
 
-    Span* span = new Span(addr, numPages);
+    std::size_t threshold = releaseThreshold();
+    std::lock_guard<std::mutex> lg(sh->mutex_);
+    sh->putToFreeLists(addr, numPages, zero);
+    sh->releaseIfExcess(threshold);
+}
+
+/* 空闲总页数 */
+std::size_t PageCache::freePages() const noexcept {
+    std::size_t total = 0;
+    for (const auto& sh : shards_)
+        total += sh.freePages_.load(std::memory_order_relaxed) +
+                 sh.cachedPages_.load(std::memory_order_relaxed);
+    return total;
+}
+
+/* 向系统持有的总页数 */
+std::size_t PageCache::systemPages() const noexcept {
+    std::size_t total = 0;
+    for (const auto& sh : shards_)
+        total += sh.systemPages_.load(std::memory_order_relaxed);
+    return total;
+}
+
+/* ────────────────────────────────────────────────────────────
+ * 无锁槽位
+ * ────────────────────────────────────────────────────────────*/
+void* PageCache::Shard::popFast(std::size_t numPages) noexcept {
+    for (auto& slot : fastSpans_[numPages]) {
+        if (!slot.load(std::memory_order_relaxed)) continue;
+        if (void* addr = slot.exchange(nullptr, std::memory_order_acquire)) {
+            cachedPages_.fetch_sub(numPages, std::memory_order_relaxed);
+            return addr;
+        }
+    }
+    return nullptr;
+}
+
+bool PageCache::Shard::pushFast(void* addr, std::size_t numPages) noexcept {
+    /* 先记账再放入，保证并发 pop 扣减时计数不会下溢 */
+    cachedPages_.fetch_add(numPages, std::memory_order_relaxed);
+    for (auto& slot : fastSpans_[numPages]) {
+        void* expected = nullptr;
+        if (slot.compare_exchange_strong(expected, addr, std::memory_order_release,
+                                         std::memory_order_relaxed))
+            return true;
+    }
+    cachedPages_.fetch_sub(numPages, std::memory_order_relaxed);
+    return false;
+}
+
+/* ────────────────────────────────────────────────────────────
+ * 空闲表（均在 mutex_ 内调用）
+ * ────────────────────────────────────────────────────────────*/
+void* PageCache::Shard::takeFromFreeLists(std::size_t numPages, bool& zeroed) {
+    /* 找第一个 >= numPages 的空闲 span */
+    auto it = freeSpans_.lower_bound(numPages);
+    if (it == freeSpans_.end()) return nullptr;
+
+    Span* span = it->second;
+    assert(span && span->numPages >= numPages);
+    zeroed = span->zeroed; // 拆分不影响标记
+
+    /* 精确匹配 —— 直接取整段 */
+    if (span->numPages == numPages) {
+        void* addr = span->pageAddr;
+        eraseSpan(span);
+        freePages_.fetch_sub(numPages, std::memory_order_relaxed);
+        return addr;
+    }
+
+    /* 较大 span —— 拆分：前半返回，后半继续留在空闲表 */
+    void* addr = span->pageAddr;
+    std::size_t remainPages = span->numPages - numPages;
+    void* remainAddr = static_cast<char*>(span->pageAddr) + numPages * kPageSize;
+
+    /* 先从两张 map 摘下，改写后重新插入 */
+    it->second = span->next;
+    if (!it->second) freeSpans_.erase(it);
+    addrSpanMap_.erase(addr);
+
+    span->pageAddr = remainAddr;
+    span->numPages = remainPages;
+    insertSpan(span);
+
+    freePages_.fetch_sub(numPages, std::memory_order_relaxed);
+    return addr;
+}
+
+void PageCache::Shard::putToFreeLists(void* addr, std::size_t numPages, bool zeroed) {
+    Span* span = new Span(addr, numPages, zeroed);
     mergeWithNeighbors(span); // 内部会把合并后的 span 插入两张 map
+    freePages_.fetch_add(span->numPages, std::memory_order_relaxed);
+}
 
-    totalFreePages_ += span->numPages;
-    releaseIfExcess();
+bool PageCache::Shard::drainFast() {
+    bool drained = false;
+    for (std::size_t n = 1; n <= kFastSpanMaxPages; ++n) {
+        for (auto& slot : fastSpans_[n]) {
+            if (void* addr = slot.exchange(nullptr, std::memory_order_acquire)) {
+                cachedPages_.fetch_sub(n, std::memory_order_relaxed);
+                putToFreeLists(addr, n, false);
+                drained = true;
+            }
+        }
+    }
+    return drained;
 }
 
-/* ~PageCache */
-PageCache::~PageCache() {
+/* 析构：删除所有 Span 节点并把系统基址统一释放 */
+void PageCache::Shard::releaseAll() {
     for (auto& kv : freeSpans_) {
         Span* node = kv.second;
         while (node) {
@@ -101,22 +307,20 @@ PageCache::~PageCache() {
             node = nxt;
         }
     }
-    /* 最后统一把所有系统基址释放一次 */
-    for (void* base : systemBases_) {
-#if __cpp_aligned_new >= 201606
-        ::operator delete(base, std::align_val_t{kPageSize});
-#else
-        std::free(base);
-#endif
-    }
+    freeSpans_.clear();
+    addrSpanMap_.clear();
+
+    for (auto& kv : systemBases_)
+        systemFreePages(kv.first, kv.second);
     systemBases_.clear();
+    systemPages_.store(0, std::memory_order_relaxed);
 }
 
 /* ────────────────────────────────────────────────────────────
  * 辅助：插入 / 删除 / 合并
  * ────────────────────────────────────────────────────────────*/
 /*──────────── 1) insertSpan ────────────*/
-void PageCache::insertSpan(Span* span) {
+void PageCache::Shard::insertSpan(Span* span) {
     auto it = freeSpans_.find(span->numPages);
     if (it == freeSpans_.end()) {
         span->next = nullptr;
@@ -129,7 +333,7 @@ void PageCache::insertSpan(Span* span) {
 }
 
 /*──────────── 2) eraseSpan ────────────*/
-void PageCache::eraseSpan(Span* span) {
+void PageCache::Shard::eraseSpan(Span* span) {
     /* 先从 size-map 链表里摘除 */
     auto it = freeSpans_.find(span->numPages);
     if (it != freeSpans_.end()) {
@@ -150,7 +354,7 @@ void PageCache::eraseSpan(Span* span) {
 }
 
 /*──────────── 3) mergeWithNeighbors ────────────*/
-void PageCache::mergeWithNeighbors(Span*& span) {
+void PageCache::Shard::mergeWithNeighbors(Span*& span) {
     /* ---------- 向前合并 ---------- */
     auto itPrev = addrSpanMap_.lower_bound(span->pageAddr);
     if (itPrev != addrSpanMap_.begin()) {
@@ -158,14 +362,16 @@ void PageCache::mergeWithNeighbors(Span*& span) {
         Span* prev = itPrev->second;
         char* prevEnd = static_cast<char*>(prev->pageAddr) + prev->numPages * kPageSize;
         if (prevEnd == span->pageAddr) {
-            void*       prevAddr  = prev->pageAddr;
-            std::size_t prevPages = prev->numPages;
+            void*       prevAddr   = prev->pageAddr;
+            std::size_t prevPages  = prev->numPages;
+            bool        prevZeroed = prev->zeroed;
 
-            totalFreePages_ -= prevPages;   // ★ 从全局计数先扣掉
-            eraseSpan(prev);                //   再删除 prev
+            freePages_.fetch_sub(prevPages, std::memory_order_relaxed); // ★ 先扣掉
+            eraseSpan(prev);                                            //   再删除 prev
 
             span->pageAddr  = prevAddr;
             span->numPages += prevPages;
+            span->zeroed    = span->zeroed && prevZeroed;
         }
     }
 
@@ -176,57 +382,78 @@ void PageCache::mergeWithNeighbors(Span*& span) {
         char* spanEnd = static_cast<char*>(span->pageAddr) + span->numPages * kPageSize;
         if (spanEnd == next->pageAddr) {
             std::size_t nextPages = next->numPages;
+            bool nextZeroed = next->zeroed;
 
-            totalFreePages_ -= nextPages;   // ★ 同理，先扣
+            freePages_.fetch_sub(nextPages, std::memory_order_relaxed); // ★ 同理，先扣
             eraseSpan(next);
 
             span->numPages += nextPages;
+            span->zeroed = span->zeroed && nextZeroed;
         }
     }
 
-    /* 把合并后的 span 重新挂回空闲表 */
+    /* 把合并后的 span 重新挂回空闲表（计数由调用者按合并后的页数补回） */
     insertSpan(span);
 }
 
 
-/* 若空闲页总量过大，则把最大的 span 直接释放给系统 */
-void PageCache::releaseIfExcess() {
+/* 若本分片空闲页总量超过 threshold，则把完整空闲的系统块直接释放给系统 */
+void PageCache::Shard::releaseIfExcess(std::size_t threshold) {
     // 只要逻辑空闲页超标，就尝试回收
-    while (totalFreePages_ > kReleaseThresholdPages && !freeSpans_.empty()) {
+    while (freePages_.load(std::memory_order_relaxed) > threshold &&
+           !freeSpans_.empty()) {
         // 从最大 span 开始往前找
         auto it = freeSpans_.end();
         bool didFree = false;
 
         // 向前迭代：注意 it 最初是 end()，要 --it
         while (it != freeSpans_.begin()) {
-            --it;  // it 现在指向 freeSpans_ 中最大的一个元素
+            --it; // it 现在指向 freeSpans_ 中最大的一个元素
             Span* span = it->second;
             void* base = span->pageAddr;
-            if (systemBases_.count(base)) {
-                // 找到真正的系统基址，执行释放
-                std::size_t pages = span->numPages;
-                eraseSpan(span);             // 从 freeSpans_/addrSpanMap_ 中删
-                systemBases_.erase(base);    // 从基址集合中删
-
-    #if __cpp_aligned_new >= 201606
-                ::operator delete(base, std::align_val_t{kPageSize});
-    #else
-                std::free(base);
-    #endif
-                totalFreePages_ -= pages;
-                didFree = true;
-                break;  // 本次循环结束，重新从尾部开始新一轮回收
-            }
-            // 否则跳过这个 span，继续往前找
+            auto bit = systemBases_.find(base);
+            // 必须以系统基址开头且完整覆盖整块系统内存，才能整块归还
+            if (bit == systemBases_.end() || span->numPages < bit->second) continue;
+
+            std::size_t pages = bit->second;
+            std::size_t remainPages = span->numPages - pages;
+            void* remainAddr = static_cast<char*>(base) + pages * kPageSize;
+            bool zero = span->zeroed;
+
+            eraseSpan(span);         // 从 freeSpans_/addrSpanMap_ 中删
+            systemBases_.erase(bit); // 从基址集合中删
+
+            // 与相邻系统块合并过的部分留在空闲表
+            if (remainPages) insertSpan(new Span(remainAddr, remainPages, zero));
+
+            // 先撤销页表登记：解除映射后内核可能把这段地址交给别的堆 / glibc
+            pageMap_->set(base, pages, 0);
+            systemFreePages(base, pages);
+            freePages_.fetch_sub(pages, std::memory_order_relaxed);
+            systemPages_.fetch_sub(pages, std::memory_order_relaxed);
+
+            didFree = true;
+            break; // 本次循环结束，重新从尾部开始新一轮回收
         }
 
         if (!didFree) {
             // 在整个 freeSpans_ 里都没有找到可释放的基址，退出
             break;
         }
-        // 如果 didFree == true，外层 while 会根据新 totalFreePages_ 决定是否继续
+        // 如果 didFree == true，外层 while 会根据新 freePages_ 决定是否继续
     }
 }
 
 
+/* 回收：槽位并回空闲表，完整空闲的系统块全部归还，其余空闲 span 交还物理页 */
+void PageCache::Shard::trim() {
+    drainFast();
+    releaseIfExcess(0);
+    for (auto& kv : addrSpanMap_) {
+        Span* span = kv.second;
+        if (span->zeroed) continue;
+        if (::madvise(span->pageAddr, span->numPages * kPageSize, MADV_DONTNEED) == 0) span->zeroed = true;
+    }
+}
+
 } // namespace mempool
@@ -0,0 +1,54 @@
+#include "PageMap.h"
+
+namespace mempool
+{
+
+PageMap::~PageMap() {
+    for (auto& slot : root_) {
+        Mid* mid = slot.load(std::memory_order_relaxed);
+        if (!mid) continue;
+        for (auto& l : mid->leaves)
+            delete l.load(std::memory_order_relaxed);
+        delete mid;
+    }
+}
+
+/* 按需创建中间层 / 叶子；并发创建时以 CAS 胜者为准，败者丢弃自己的节点 */
+PageMap::Leaf* PageMap::ensureLeaf(std::uintptr_t pn) {
+    auto& midSlot = root_[rootIndex(pn)];
+    Mid* mid = midSlot.load(std::memory_order_acquire);
+    if (!mid) {
+        Mid* fresh = new Mid();
+        if (midSlot.compare_exchange_strong(mid, fresh, std::memory_order_acq_rel))
+            mid = fresh;
+        else
+            delete fresh; // mid 已被 CAS 更新为胜者
+    }
+
+    auto& leafSlot = mid->leaves[midIndex(pn)];
+    Leaf* leaf = leafSlot.load(std::memory_order_acquire);
+    if (!leaf) {
+        Leaf* fresh = new Leaf();
+        if (leafSlot.compare_exchange_strong(leaf, fresh, std::memory_order_acq_rel))
+            leaf = fresh;
+        else
+            delete fresh;
+    }
+    return leaf;
+}
+
+void PageMap::set(const void* addr, std::size_t numPages, std::uint8_t value) {
+    std::uintptr_t pn = reinterpret_cast<std::uintptr_t>(addr) >> kPageShift;
+    std::uintptr_t end = pn + numPages;
+
+    while (pn < end) {
+        Leaf* leaf = ensureLeaf(pn);
+        /* 一次写满当前叶子覆盖的部分 */
+        std::uintptr_t leafEnd = (pn | (kLevelSize - 1)) + 1;
+        if (leafEnd > end) leafEnd = end;
+        for (; pn < leafEnd; ++pn)
+            leaf->owner[leafIndex(pn)].store(value, std::memory_order_relaxed);
+    }
+}
+
+} // namespace mempool
@@ -0,0 +1,349 @@
+#include "SharedPool.h"
+
+#include <algorithm> // std::max
+#include <cerrno>
+#include <new> // std::bad_alloc / placement new
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mempool
+{
+
+/* 区域头部：位于基址处，所有链接均为相对基址的偏移（0 表示空） */
+struct SharedPool::Region {
+    std::uint64_t magic;    // 初始化完成后最后写入
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t bytes;    // 区域总字节数
+    std::uint64_t base;     // 创建时的映射基址
+
+    pthread_mutex_t pageLock;        // 保护 top / freeSpans
+    std::uint64_t top;               // 从未分配过的页区起点
+    std::uint64_t freeSpans;         // 空闲 span 链（按偏移升序）
+
+    std::atomic<std::uint64_t> root; // 用户根偏移
+
+    pthread_mutex_t classLocks[kLockStripes];
+    std::uint64_t freeList[kFreeListNum]; // 各 size-class 空闲链（块头偏移）
+};
+
+namespace
+{
+
+constexpr std::uint64_t kSharedMagic = 0x4c4f4f5048534d4dull; // "MMSHPOOL"
+constexpr std::uint32_t kSharedVersion = 1;
+
+/* 空闲 span 的前 16 字节：页数与后继偏移 */
+struct FreeSpan {
+    std::uint64_t pages;
+    std::uint64_t next;
+};
+
+/* 区域中的块头：与 BlockHeader 同布局，next 字段改存偏移 */
+struct SharedBlock {
+    std::uint64_t size;
+    std::uint64_t next;
+};
+static_assert(sizeof(SharedBlock) == sizeof(BlockHeader), "shared block header must match BlockHeader");
+
+/* robust 互斥量：持锁进程死亡时接手，区域仍可继续使用 */
+class RobustLock {
+public:
+    explicit RobustLock(pthread_mutex_t* m) : m_(m) {
+        if (pthread_mutex_lock(m_) == EOWNERDEAD) pthread_mutex_consistent(m_);
+    }
+    ~RobustLock() { pthread_mutex_unlock(m_); }
+
+    RobustLock(const RobustLock&) = delete;
+    RobustLock& operator=(const RobustLock&) = delete;
+
+private:
+    pthread_mutex_t* m_;
+};
+
+void initSharedMutex(pthread_mutex_t* m) {
+    pthread_mutexattr_t a;
+    pthread_mutexattr_init(&a);
+    pthread_mutexattr_setpshared(&a, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&a, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(m, &a);
+    pthread_mutexattr_destroy(&a);
+}
+
+/* 映射到固定基址；内核不支持 MAP_FIXED_NOREPLACE 时按提示地址映射并核对。base 为空时由内核选址 */
+char* mapAt(int fd, std::size_t bytes, void* base) {
+    if (!base) {
+        void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        return p == MAP_FAILED ? nullptr : static_cast<char*>(p);
+    }
+
+    int flags = MAP_SHARED;
+#ifdef MAP_FIXED_NOREPLACE
+    flags |= MAP_FIXED_NOREPLACE;
+#endif
+    void* p = ::mmap(base, bytes, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if (p == MAP_FAILED) return nullptr;
+    if (p != base) {
+        ::munmap(p, bytes);
+        errno = EEXIST;
+        return nullptr;
+    }
+    return static_cast<char*>(p);
+}
+
+/* size-class 每次切出的 span 页数：与 CentralCache 默认策略一致（至少 8 页、至少 4 块） */
+std::size_t classSpanPages(std::size_t index) noexcept {
+    std::size_t blkBytes = SizeClass::blockBytes(index);
+    return std::max<std::size_t>((blkBytes * 4 + kPageSize - 1) / kPageSize, 8);
+}
+
+/* 大对象占用的页数（含头部） */
+inline std::size_t largePages(std::size_t size) noexcept {
+    return (size + sizeof(SharedBlock) + kPageSize - 1) / kPageSize;
+}
+
+} // namespace
+
+std::size_t SharedPool::dataOffset() noexcept { return (sizeof(Region) + kPageSize - 1) & ~(kPageSize - 1); }
+
+std::unique_ptr<SharedPool> SharedPool::create(const char* path, std::size_t bytes, void* base) {
+    bytes = (bytes + kPageSize - 1) & ~(kPageSize - 1);
+    if (bytes <= dataOffset()) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    int fd = path ? ::open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600)
+                  : ::memfd_create("mempool-shared", MFD_CLOEXEC);
+    if (fd < 0) return nullptr;
+
+    char* mem = nullptr;
+    if (::ftruncate(fd, static_cast<off_t>(bytes)) != 0 || !(mem = mapAt(fd, bytes, base))) {
+        int err = errno;
+        ::close(fd);
+        if (path) ::unlink(path);
+        errno = err;
+        return nullptr;
+    }
+
+    /* 新文件内容全零：链表为空、top 从页区起点开始；魔数最后写入，未初始化完的区域不可 attach */
+    auto* r = new (mem) Region;
+    r->version = kSharedVersion;
+    r->bytes = bytes;
+    r->base = reinterpret_cast<std::uint64_t>(mem);
+    initSharedMutex(&r->pageLock);
+    for (auto& m : r->classLocks)
+        initSharedMutex(&m);
+    r->top = dataOffset();
+    r->freeSpans = 0;
+    r->root.store(0, std::memory_order_relaxed);
+    __atomic_store_n(&r->magic, kSharedMagic, __ATOMIC_RELEASE);
+
+    return std::unique_ptr<SharedPool>(new SharedPool(fd, mem, bytes));
+}
+
+std::unique_ptr<SharedPool> SharedPool::attach(const char* path) {
+    int fd = ::open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    auto pool = attach(fd);
+    int err = errno;
+    ::close(fd);
+    errno = err;
+    return pool;
+}
+
+std::unique_ptr<SharedPool> SharedPool::attach(int fd) {
+    /* 先读头部拿到基址与大小 */
+    Region hdr;
+    if (::pread(fd, &hdr, sizeof(hdr), 0) != static_cast<ssize_t>(sizeof(hdr)) ||
+        hdr.magic != kSharedMagic || hdr.version != kSharedVersion) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<std::uint64_t>(st.st_size) < hdr.bytes) {
+        errno = EINVAL;
+        return nullptr;
+    }
+
+    int own = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (own < 0) return nullptr;
+    char* mem = mapAt(own, hdr.bytes, reinterpret_cast<void*>(hdr.base));
+    if (!mem) {
+        int err = errno;
+        ::close(own);
+        errno = err;
+        return nullptr;
+    }
+    return std::unique_ptr<SharedPool>(new SharedPool(own, mem, hdr.bytes));
+}
+
+SharedPool::~SharedPool() {
+    ::munmap(base_, bytes_);
+    ::close(fd_);
+}
+
+std::uint64_t SharedPool::root() const noexcept { return region()->root.load(std::memory_order_acquire); }
+
+void SharedPool::setRoot(std::uint64_t offset) noexcept { region()->root.store(offset, std::memory_order_release); }
+
+/* 首次适配：从空闲 span 链切，不够再从 top 推进 */
+std::uint64_t SharedPool::allocPages(std::size_t pages) {
+    Region* r = region();
+    const std::uint64_t need = pages * kPageSize;
+
+    std::uint64_t* link = &r->freeSpans;
+    while (std::uint64_t off = *link) {
+        auto* s = reinterpret_cast<FreeSpan*>(base_ + off);
+        if (s->pages >= pages) {
+            if (s->pages > pages) {
+                /* 剩余部分原位留在链上 */
+                auto* rest = reinterpret_cast<FreeSpan*>(base_ + off + need);
+                rest->pages = s->pages - pages;
+                rest->next = s->next;
+                *link = off + need;
+            } else {
+                *link = s->next;
+            }
+            return off;
+        }
+        link = &s->next;
+    }
+
+    if (r->top + need > r->bytes) return 0;
+    std::uint64_t off = r->top;
+    r->top += need;
+    return off;
+}
+
+/* 按偏移有序插入并与两侧相邻 span 合并；与 top 相接时直接退回 top，空闲链保持短小 */
+void SharedPool::freePages(std::uint64_t offset, std::size_t pages) {
+    Region* r = region();
+
+    if (offset + pages * kPageSize == r->top) {
+        r->top = offset;
+        /* 链已有序且相邻者已合并：只有链尾可能恰好与新的 top 相接 */
+        std::uint64_t* link = &r->freeSpans;
+        while (*link && reinterpret_cast<FreeSpan*>(base_ + *link)->next)
+            link = &reinterpret_cast<FreeSpan*>(base_ + *link)->next;
+        if (std::uint64_t last = *link) {
+            auto* s = reinterpret_cast<FreeSpan*>(base_ + last);
+            if (last + s->pages * kPageSize == r->top) {
+                r->top = last;
+                *link = 0;
+            }
+        }
+        return;
+    }
+
+    std::uint64_t prev = 0;
+    std::uint64_t* link = &r->freeSpans;
+    while (*link && *link < offset) {
+        prev = *link;
+        link = &reinterpret_cast<FreeSpan*>(base_ + prev)->next;
+    }
+
+    auto* s = reinterpret_cast<FreeSpan*>(base_ + offset);
+    s->pages = pages;
+    s->next = *link;
+
+    /* 与后继合并 */
+    if (s->next && offset + s->pages * kPageSize == s->next) {
+        auto* n = reinterpret_cast<FreeSpan*>(base_ + s->next);
+        s->pages += n->pages;
+        s->next = n->next;
+    }
+
+    /* 与前驱合并，否则挂在前驱之后 */
+    auto* p = prev ? reinterpret_cast<FreeSpan*>(base_ + prev) : nullptr;
+    if (p && prev + p->pages * kPageSize == offset) {
+        p->pages += s->pages;
+        p->next = s->next;
+    } else {
+        *link = offset;
+    }
+}
+
+/* 新 span 整段切块挂入空闲链（区域中的块头常驻共享内存，不做按需切块） */
+void SharedPool::refillClass(std::size_t index) {
+    const std::size_t pages = classSpanPages(index);
+    std::uint64_t span;
+    {
+        RobustLock lk(&region()->pageLock);
+        span = allocPages(pages);
+    }
+    if (!span) throw std::bad_alloc();
+
+    const std::size_t blkBytes = SizeClass::blockBytes(index);
+    const std::size_t n = pages * kPageSize / blkBytes;
+    std::uint64_t head = region()->freeList[index];
+    for (std::size_t i = n; i-- > 0;) {
+        std::uint64_t off = span + i * blkBytes;
+        auto* b = reinterpret_cast<SharedBlock*>(base_ + off);
+        b->size = SizeClass::userBytes(index);
+        b->next = head;
+        head = off;
+    }
+    region()->freeList[index] = head;
+}
+
+void* SharedPool::allocate(std::size_t size) {
+    if (size == 0) size = kAlignment;
+
+    /* 大对象：直接按页分配 */
+    if (size > kMaxBytes) {
+        std::uint64_t off;
+        {
+            RobustLock lk(&region()->pageLock);
+            off = allocPages(largePages(size));
+        }
+        if (!off) throw std::bad_alloc();
+        auto* b = reinterpret_cast<SharedBlock*>(base_ + off);
+        b->size = size;
+        b->next = 0;
+        return b + 1;
+    }
+
+    const std::size_t index = SizeClass::getIndex(size);
+    RobustLock lk(&region()->classLocks[index % kLockStripes]);
+    if (!region()->freeList[index]) refillClass(index);
+
+    std::uint64_t off = region()->freeList[index];
+    auto* b = reinterpret_cast<SharedBlock*>(base_ + off);
+    region()->freeList[index] = b->next;
+    b->next = 0;
+    return b + 1;
+}
+
+void SharedPool::deallocate(void* ptr) {
+    if (!ptr) return;
+
+    auto* b = reinterpret_cast<SharedBlock*>(ptr) - 1;
+    const std::uint64_t off = offsetOf(b);
+
+    if (b->size > kMaxBytes) {
+        RobustLock lk(&region()->pageLock);
+        freePages(off, largePages(b->size));
+        return;
+    }
+
+    const std::size_t index = SizeClass::getIndex(b->size);
+    RobustLock lk(&region()->classLocks[index % kLockStripes]);
+    b->next = region()->freeList[index];
+    region()->freeList[index] = off;
+}
+
+std::size_t SharedPool::freeBytes() const {
+    Region* r = region();
+    RobustLock lk(&r->pageLock);
+    std::size_t bytes = r->bytes - r->top;
+    for (std::uint64_t off = r->freeSpans; off; off = reinterpret_cast<FreeSpan*>(base_ + off)->next)
+        bytes += reinterpret_cast<FreeSpan*>(base_ + off)->pages * kPageSize;
+    return bytes;
+}
+
+} // namespace mempool
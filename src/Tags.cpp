@@ -0,0 +1,155 @@
+#include "Tags.h"
+
+#include <array>
+#include <mutex>
+
+namespace mempool
+{
+namespace
+{
+
+/* 单线程写、任意线程读：load + store 即可，无需 lock 前缀 */
+template <typename T>
+inline void bump(std::atomic<T>& c, T n) noexcept {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+struct Counter {
+    std::atomic<std::int64_t> liveBytes{0};
+    std::atomic<std::uint64_t> allocCount{0};
+    std::atomic<std::uint64_t> allocBytes{0};
+    std::atomic<std::uint64_t> freeCount{0};
+};
+
+struct ThreadTags;
+
+/* 存活线程的计数登记表（侵入式双链表，登记不分配内存）；已退出线程的计数并入 exited */
+std::mutex registryMutex;
+ThreadTags* registry{nullptr};
+std::array<TagStats, Tags::kMaxTags> exited{};
+
+std::array<std::atomic<std::size_t>, Tags::kMaxTags> budgets{};
+std::array<std::atomic<bool>, Tags::kMaxTags> overBudget{};
+std::atomic<Tags::BudgetHandler> budgetHandler{nullptr};
+
+/* 本线程计数：析构后置 destroyed，之后（其它 TLS 析构函数中）的分配 / 释放直接记入 exited */
+thread_local ThreadTags* tlsTags{nullptr};
+thread_local bool tagsDestroyed{false};
+
+struct ThreadTags {
+    std::array<Counter, Tags::kMaxTags> counters;
+    std::uint32_t sinceCheck{0};
+    ThreadTags* prev{nullptr};
+    ThreadTags* next{nullptr};
+
+    ThreadTags() noexcept {
+        std::lock_guard<std::mutex> lg(registryMutex);
+        next = registry;
+        if (registry) registry->prev = this;
+        registry = this;
+    }
+
+    ~ThreadTags() {
+        std::lock_guard<std::mutex> lg(registryMutex);
+        for (std::size_t t = 0; t < Tags::kMaxTags; ++t) {
+            const Counter& c = counters[t];
+            exited[t].liveBytes += c.liveBytes.load(std::memory_order_relaxed);
+            exited[t].allocCount += c.allocCount.load(std::memory_order_relaxed);
+            exited[t].allocBytes += c.allocBytes.load(std::memory_order_relaxed);
+            exited[t].freeCount += c.freeCount.load(std::memory_order_relaxed);
+        }
+        (prev ? prev->next : registry) = next;
+        if (next) next->prev = prev;
+        tlsTags = nullptr;
+        tagsDestroyed = true;
+    }
+};
+
+/* 本线程计数；已析构时返回 nullptr */
+ThreadTags* localTags() noexcept {
+    if (tlsTags) return tlsTags;
+    if (tagsDestroyed) return nullptr;
+    thread_local ThreadTags tags;
+    tlsTags = &tags;
+    return tlsTags;
+}
+
+/* 汇总后与预算比较：越线时回调一次，回落到预算内后重新布防 */
+void checkBudget(Tags::Tag tag) {
+    std::size_t budget = budgets[tag].load(std::memory_order_relaxed);
+    if (!budget) return;
+
+    std::int64_t live = Tags::stats(tag).liveBytes;
+    if (live > static_cast<std::int64_t>(budget)) {
+        if (!overBudget[tag].exchange(true, std::memory_order_relaxed))
+            if (auto h = budgetHandler.load(std::memory_order_acquire)) h(tag, live);
+    } else {
+        overBudget[tag].store(false, std::memory_order_relaxed);
+    }
+}
+
+} // namespace
+
+void Tags::attach(void* ptr, Tag tag) noexcept {
+    if (!ptr || !tag) return;
+    if (!enabled()) enabled_.store(true, std::memory_order_relaxed);
+
+    auto* hd = static_cast<BlockHeader*>(ptr) - 1;
+    const std::size_t bytes = sizeOf(hd->size);
+    hd->size = bytes | (hd->size & Guard::kGuardedFlag) | (std::uint64_t{tag} << kTagShift);
+
+    ThreadTags* local = localTags();
+    if (!local) [[unlikely]] {
+        std::lock_guard<std::mutex> lg(registryMutex);
+        exited[tag].liveBytes += static_cast<std::int64_t>(bytes);
+        exited[tag].allocCount += 1;
+        exited[tag].allocBytes += bytes;
+        return;
+    }
+    Counter& c = local->counters[tag];
+    bump(c.liveBytes, static_cast<std::int64_t>(bytes));
+    bump(c.allocCount, std::uint64_t{1});
+    bump(c.allocBytes, static_cast<std::uint64_t>(bytes));
+
+    if (budgets[tag].load(std::memory_order_relaxed) && ++local->sinceCheck >= kBudgetCheckInterval) {
+        local->sinceCheck = 0;
+        checkBudget(tag);
+    }
+}
+
+void Tags::onFree(Tag tag, std::size_t bytes) noexcept {
+    ThreadTags* local = localTags();
+    if (!local) [[unlikely]] {
+        std::lock_guard<std::mutex> lg(registryMutex);
+        exited[tag].liveBytes -= static_cast<std::int64_t>(bytes);
+        exited[tag].freeCount += 1;
+        return;
+    }
+    Counter& c = local->counters[tag];
+    bump(c.liveBytes, -static_cast<std::int64_t>(bytes));
+    bump(c.freeCount, std::uint64_t{1});
+}
+
+TagStats Tags::stats(Tag tag) {
+    std::lock_guard<std::mutex> lg(registryMutex);
+    TagStats s = exited[tag];
+    for (ThreadTags* t = registry; t; t = t->next) {
+        const Counter& c = t->counters[tag];
+        s.liveBytes += c.liveBytes.load(std::memory_order_relaxed);
+        s.allocCount += c.allocCount.load(std::memory_order_relaxed);
+        s.allocBytes += c.allocBytes.load(std::memory_order_relaxed);
+        s.freeCount += c.freeCount.load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+void Tags::setBudget(Tag tag, std::size_t bytes) noexcept {
+    budgets[tag].store(bytes, std::memory_order_relaxed);
+    overBudget[tag].store(false, std::memory_order_relaxed);
+}
+
+Tags::BudgetHandler Tags::setBudgetHandler(BudgetHandler handler) noexcept {
+    return budgetHandler.exchange(handler, std::memory_order_acq_rel);
+}
+
+} // namespace mempool
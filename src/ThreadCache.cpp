@@ -1,105 +1,266 @@
 #include "ThreadCache.h"
 
+#include <algorithm> // std::min
 #include <cassert>
-#include <cstdlib> // malloc / free
+#include <cstdint>
+#include <cstdlib> // malloc / calloc / free
+#include <cstring> // std::memset
 #include <new>     // std::bad_alloc
 
+#include <sys/mman.h> // madvise
+
+#include "Tags.h" // 带标签块的释放
+
 namespace mempool
 {
-/* 单例：每个线程一个实例 */
-ThreadCache& ThreadCache::getInstance() {
-    thread_local ThreadCache tc;
-    return tc;
+/* 线程首次使用：构造本线程实例并发布到 initial-exec TLS 指针，之后只走内联快速路径 */
+ThreadCache* ThreadCache::initSlow() {
+    if (tornDown_) return nullptr;
+    thread_local ThreadCache tc(CentralCache::getInstance());
+    tls_ = &tc;
+    return &tc;
 }
 
 /* 构造：初始化链表数组 */
-ThreadCache::ThreadCache() {
+ThreadCache::ThreadCache(CentralCache& central)
+    : central_(central), trimSeen_(CentralCache::trimEpoch()), optionsSeen_(Options::generation()) {
+    std::size_t budget = Options::tcacheMaxBytes();
+    budget_ = budget ? budget : SIZE_MAX;
+    sampleLeft_ = Guard::nextInterval();
     freeList_.fill(nullptr);
     freeListSize_.fill(0);
 }
 
-/* 批量数策略：越小的块一次拿越多 */
-std::size_t ThreadCache::batchNumForSize(std::size_t bytes) noexcept {
-    if (bytes <= 128) return 512;  // 128 B
-    if (bytes <= 1024) return 128; // 1 KB
-    if (bytes <= 8192) return 32;  // 8 KB
-    if (bytes <= 65536) return 8;  // 64 KB
-    return 4;                      // 128 KB < bitys <= kMaxBytes
+/* 线程退出：默认池实例（即 tls_ 所指）把空闲块交回；独立堆的实例由 Heap 决定是否 flush（所属堆可能已销毁）。
+   退休块可能仍被其它线程读取，不能就地释放，交给孤儿表由其它线程到期后回收 */
+ThreadCache::~ThreadCache() {
+    if (tls_ == this) {
+        flush();
+        tls_ = nullptr;
+        tornDown_ = true;
+    }
+    for (auto& bag : retired_)
+        Epoch::orphan(bag.head, bag.epoch);
+    /* 记录归还后可能立即被新线程领取，不能再经本实例写入 */
+    if (epochRec_) {
+        Epoch::release(epochRec_);
+        epochRec_ = nullptr;
+    }
 }
 
-void* ThreadCache::allocate(std::size_t size) {
-    if (size == 0) size = kAlignment;
+/* 大对象：直接调用 malloc，但仍加头部保持统一回收逻辑 */
+void* ThreadCache::allocateLarge(std::size_t size) {
+    std::size_t total = size + sizeof(BlockHeader);
+    auto* raw = static_cast<char*>(std::malloc(total));
+    if (!raw) throw std::bad_alloc();
 
-    /* 大对象：直接调用 malloc，但仍加头部保持统一回收逻辑 */
-    if (size > kMaxBytes) {
-        std::size_t total = size + sizeof(BlockHeader);
-        auto* raw = static_cast<char*>(std::malloc(total));
-        if (!raw) throw std::bad_alloc();
+    auto* hd = reinterpret_cast<BlockHeader*>(raw);
+    hd->size = size;
+    hd->next = nullptr;
+    return hd + 1; // 跳过头部返回给用户，加 1 相当于 + 1* sizeof (BlockHeader)
+}
 
-        auto* hd = reinterpret_cast<BlockHeader*>(raw);
-        hd->size = size;
-        hd->next = nullptr;
-        return hd + 1; // 跳过头部返回给用户，加 1 相当于 + 1* sizeof (BlockHeader)
+/* 守护块不属于独立堆：Heap::deallocate 会把 size 高位当作大对象交给自己的 PageCache */
+void* ThreadCache::allocateSampled(std::size_t size) {
+    if (&central_ != &CentralCache::getInstance()) {
+        sampleLeft_ = UINT32_MAX;
+        return nullptr;
+    }
+    sampleLeft_ = Guard::nextInterval();
+    return Options::guardSampleRate() ? Guard::allocate(size) : nullptr;
+}
+
+void ThreadCache::deallocateLarge(BlockHeader* hd) {
+    if (!releaseLarge(hd)) deallocate(hd + 1);
+}
+
+bool ThreadCache::releaseLarge(BlockHeader* hd) {
+    std::uint64_t raw = hd->size;
+    std::size_t bytes = Tags::sizeOf(raw);
+    if (Tags::Tag tag = Tags::tagOf(raw)) Tags::onFree(tag, bytes);
+
+    if (raw & Guard::kGuardedFlag) {
+        Guard::deallocate(hd + 1);
+        return true;
     }
+    if (bytes <= kMaxBytes) {
+        hd->size = bytes;
+        return false;
+    }
+    std::free(hd);
+    return true;
+}
+
+/* 实例已析构：逐块直接找 CentralCache，不再留下任何本地缓存 */
+void ThreadCache::deallocateDirect(void* ptr) {
+    if (!ptr) return;
+    auto* hd = reinterpret_cast<BlockHeader*>(ptr) - 1;
+    if (hd->size > kMaxBytes && releaseLarge(hd)) return;
+
+    hd->next = nullptr;
+    CentralCache::getInstance().returnBatch(hd, 1, SizeClass::getIndex(hd->size));
+}
 
-    /* 小对象：先尝试本线程空闲链 */
-    std::size_t index = SizeClass::getIndex(size);  // 获取空闲块链表的 index
+/* 链表过长 / 超出字节预算 / 收缩请求：都不在命中路径上 */
+void ThreadCache::deallocateSlow(BlockHeader* hd, std::size_t index) {
+    /* 参数有变：所有类的链长上限都可能过时，清零后各类在下一次越线检查时重新计算 */
+    if (std::uint64_t gen = Options::generation(); gen != optionsSeen_) [[unlikely]] {
+        optionsSeen_ = gen;
+        listLimit_.fill(0);
+    }
+    std::size_t limit = listLimit(index);
+    listLimit_[index] = static_cast<std::uint32_t>(std::min<std::size_t>(limit, UINT32_MAX));
+    std::size_t budget = Options::tcacheMaxBytes();
+    budget_ = budget ? budget : SIZE_MAX;
 
-    /* 对应的空闲链表不为空的情况 */
+    if (shouldReturnToCentralCache(index)) returnToCentralCache(hd, index);
+    checkTrim();
+}
+
+void* ThreadCache::fetchFromCentralCache(std::size_t index) {
+    checkTrim();
+    if (!refillFromCentralCache(index)) return nullptr; // PageCache 也没拿到，极端情况
+
+    /* 回收链优先：第一个给用户，其余留在本地链 */
     if (BlockHeader* hd = freeList_[index]) {
         freeList_[index] = hd->next;
         freeListSize_[index]--;
+        cachedBytes_ -= SizeClass::blockBytes(index);
+        hd->next = nullptr;
         return hd + 1;
     }
+    return carve(index);
+}
 
-    /* 空链为空则向 CentralCache 批量要 */
-    return fetchFromCentralCache(index);
+bool ThreadCache::refillFromCentralCache(std::size_t index) {
+    /* Central 尽力而为地提供 */
+    BlockBatch batch = central_.fetchBatch(index, batchNum(index));
+
+    /* 未切分区间留在本地，按需切块 */
+    bumpCur_[index] = batch.bumpBegin;
+    bumpEnd_[index] = batch.bumpEnd;
+    bumpZeroed_[index] = batch.bumpZeroed;
+
+    /* 回收链整体挂到本地链（调用时本地链为空） */
+    freeList_[index] = batch.list;
+    freeListSize_[index] += batch.listCount;
+    cachedBytes_ += batch.listCount * SizeClass::blockBytes(index);
+
+    return batch.list || batch.bumpBegin != batch.bumpEnd;
 }
 
-void ThreadCache::deallocate(void* ptr) {
-    if (!ptr) return;
+std::size_t ThreadCache::reserve(std::size_t size, std::size_t count) {
+    if (size == 0) size = kAlignment;
+    if (size > kMaxBytes) return 0; // 大对象走 malloc，无从预热
 
-    auto* hd = reinterpret_cast<BlockHeader*>(ptr) - 1;
-    std::size_t bytes = hd->size;
+    std::size_t index = SizeClass::getIndex(size);
+    std::size_t cap = listLimit(index);
+    if (count > cap) count = cap;
+
+    while (localBlocks(index) < count) {
+        /* 旧区间剩余块先切好挂链，腾出位置给新区间 */
+        spillBumpToList(index);
+
+        BlockBatch batch = central_.fetchBatch(index, count - localBlocks(index));
+        if (!batch.list && batch.bumpBegin == batch.bumpEnd) break;
 
-    /* 大对象：直接交由系统释放 */
-    if (bytes > kMaxBytes) {
-        std::free(hd);
-        return;
+        /* 回收链接到本地链前面 */
+        if (batch.list) {
+            BlockHeader* tail = batch.list;
+            while (tail->next)
+                tail = tail->next;
+            tail->next = freeList_[index];
+            freeList_[index] = batch.list;
+            freeListSize_[index] += batch.listCount;
+            cachedBytes_ += batch.listCount * SizeClass::blockBytes(index);
+        }
+        bumpCur_[index] = batch.bumpBegin;
+        bumpEnd_[index] = batch.bumpEnd;
+        bumpZeroed_[index] = batch.bumpZeroed;
     }
+    return localBlocks(index);
+}
 
-    std::size_t index = SizeClass::getIndex(bytes);
+void ThreadCache::spillBumpToList(std::size_t index) noexcept {
+    while (bumpCur_[index] != bumpEnd_[index]) {
+        auto* hd = static_cast<BlockHeader*>(carve(index)) - 1;
+        hd->next = freeList_[index];
+        freeList_[index] = hd;
+        freeListSize_[index]++;
+        cachedBytes_ += SizeClass::blockBytes(index);
+    }
+}
 
-    hd->next = freeList_[index];
-    freeList_[index] = hd;
-    freeListSize_[index]++;
+/* 整体交回：逐类把空闲链（含切好的未切分区间）还给 CentralCache */
+void ThreadCache::flush() {
+    trimSeen_ = CentralCache::trimEpoch();
+    for (std::size_t i = 0; i < kFreeListNum; ++i) {
+        spillBumpToList(i);
+        if (!freeList_[i]) continue;
+        central_.returnBatch(freeList_[i], freeListSize_[i], i);
+        freeList_[i] = nullptr;
+        freeListSize_[i] = 0;
+    }
+    cachedBytes_ = 0;
+    central_.sweep();
+}
 
-    /* 链表过长 → 归还部分给 CentralCache */
-    if (shouldReturnToCentralCache(index)) returnToCentralCache(hd, index);
+/* 大于此字节数的块清零时，整页部分改用 MADV_DONTNEED 交给内核按需补零页 */
+static constexpr std::size_t kMadviseClearBytes = 64 * 1024;
+
+/* 清零一块用户内存：小块直接 memset；大块首尾 memset，中间整页 madvise */
+static void clearBlock(void* p, std::size_t bytes) noexcept {
+    if (bytes >= kMadviseClearBytes) {
+        char* b = static_cast<char*>(p);
+        char* e = b + bytes;
+        char* pb = reinterpret_cast<char*>((reinterpret_cast<std::uintptr_t>(b) + kPageSize - 1) &
+                                           ~(kPageSize - 1));
+        char* pe = reinterpret_cast<char*>(reinterpret_cast<std::uintptr_t>(e) & ~(kPageSize - 1));
+        if (pe > pb && ::madvise(pb, pe - pb, MADV_DONTNEED) == 0) {
+            std::memset(b, 0, pb - b);
+            std::memset(pe, 0, e - pe);
+            return;
+        }
+    }
+    std::memset(p, 0, bytes);
 }
 
-void* ThreadCache::fetchFromCentralCache(std::size_t index) {
-    std::size_t userBytes = (index + 1) * kAlignment;
-    std::size_t batchNum = batchNumForSize(userBytes);
+void* ThreadCache::allocateZeroed(std::size_t size) {
+    /* 守护槽位的数据页释放时已 MADV_DONTNEED，复用时内容全零 */
+    if (--sampleLeft_ == 0) [[unlikely]]
+        if (void* p = allocateSampled(size)) return p;
 
-    /* Central 尽力而为地提供 */
-    BlockHeader* list = CentralCache::getInstance().fetchBatch(index, batchNum);
-    if (!list) return nullptr; // PageCache 也没拿到，极端情况
+    if (size == 0) size = kAlignment;
+
+    /* 大对象：calloc 自己知道哪些页是全零的 */
+    if (size > kMaxBytes) {
+        auto* hd = static_cast<BlockHeader*>(std::calloc(1, size + sizeof(BlockHeader)));
+        if (!hd) throw std::bad_alloc();
+        hd->size = size;
+        return hd + 1;
+    }
 
-    /* list 已经是 BlockHeader 链：第一个给用户，其余挂回本地链 */
-    BlockHeader* headUser = list;
-    BlockHeader* remain = headUser->next;
+    std::size_t index = SizeClass::getIndex(size);
+    std::size_t userBytes = SizeClass::userBytes(index);
 
-    /* 统计实际 remain 链的节点数（可能 < batchNum-1） */
-    std::size_t actual = 0;
-    for (BlockHeader* p = remain; p != nullptr; p = p->next)
-        ++actual;
+    if (!freeList_[index] && bumpCur_[index] == bumpEnd_[index] && !refillFromCentralCache(index))
+        return nullptr;
 
-    freeList_[index] = remain;
-    freeListSize_[index] += actual;
+    /* 回收块：内容是上一任使用者留下的，必须清零 */
+    if (BlockHeader* hd = freeList_[index]) {
+        freeList_[index] = hd->next;
+        freeListSize_[index]--;
+        cachedBytes_ -= SizeClass::blockBytes(index);
+        hd->next = nullptr;
+        clearBlock(hd + 1, userBytes);
+        return hd + 1;
+    }
 
-    headUser->next = nullptr;
-    return headUser + 1;
+    /* 新切出的块：区间已知全零则跳过（块头在用户区之外） */
+    bool zeroed = bumpZeroed_[index];
+    void* p = carve(index);
+    if (!zeroed) clearBlock(p, userBytes);
+    return p;
 }
 
 /* 将本地空链拆成 keep / return 两段（keep ≈ 1/4） */
@@ -121,8 +282,100 @@ void ThreadCache::returnToCentralCache(BlockHeader* start, std::size_t index) {
 
     freeList_[index] = start;
     freeListSize_[index] = keepCnt;
+    cachedBytes_ -= retCnt * SizeClass::blockBytes(index);
+
+    central_.returnBatch(retList, retCnt, index);
+}
+
+void* ThreadCache::allocateDirect(std::size_t size, bool zero) {
+    if (size == 0) size = kAlignment;
+    if (size > kMaxBytes) {
+        if (!zero) return allocateLarge(size);
+        auto* hd = static_cast<BlockHeader*>(std::calloc(1, size + sizeof(BlockHeader)));
+        if (!hd) throw std::bad_alloc();
+        hd->size = size;
+        return hd + 1;
+    }
+
+    std::size_t index = SizeClass::getIndex(size);
+    BlockBatch batch = CentralCache::getInstance().fetchBatch(index, 1);
+    BlockHeader* hd = batch.list;
+    bool fresh = !hd && batch.bumpBegin != batch.bumpEnd;
+    if (fresh) {
+        hd = reinterpret_cast<BlockHeader*>(batch.bumpBegin);
+        hd->size = SizeClass::userBytes(index);
+    }
+    if (!hd) return nullptr;
 
-    CentralCache::getInstance().returnBatch(retList, retCnt, index);
+    hd->next = nullptr;
+    if (zero && !(fresh && batch.bumpZeroed)) clearBlock(hd + 1, SizeClass::userBytes(index));
+    return hd + 1;
+}
+
+/* 退休：纪元须在调用者把 ptr 从共享结构摘除之后读取 */
+void ThreadCache::retire(void* ptr) {
+    if (!ptr) return;
+    auto* hd = reinterpret_cast<BlockHeader*>(ptr) - 1;
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const std::uint64_t e = Epoch::global();
+
+    RetireBag& bag = retired_[e % retired_.size()];
+    if (bag.epoch != e) {
+        /* 同一格里的旧链至少早 3 个纪元退休，早已到期 */
+        freeRetiredChain(bag.head);
+        bag = {nullptr, 0, e};
+    }
+    hd->next = bag.head;
+    bag.head = hd;
+    ++bag.count;
+
+    if (++retiredSinceScan_ >= kRetireScanInterval) {
+        retiredSinceScan_ = 0;
+        Epoch::tryAdvance();
+        releaseExpiredRetired();
+    }
+}
+
+void ThreadCache::retireOrphan(void* ptr) {
+    if (!ptr) return;
+    auto* hd = reinterpret_cast<BlockHeader*>(ptr) - 1;
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    hd->next = nullptr;
+    Epoch::orphan(hd, Epoch::global());
+}
+
+std::size_t ThreadCache::collectRetired() {
+    for (std::uint64_t i = 0; i < Epoch::kGracePeriods; ++i)
+        if (!Epoch::tryAdvance()) break;
+    releaseExpiredRetired();
+
+    std::size_t pending = 0;
+    for (const auto& bag : retired_)
+        pending += bag.count;
+    return pending;
+}
+
+void ThreadCache::releaseExpiredRetired() {
+    const std::uint64_t e = Epoch::global();
+    for (auto& bag : retired_) {
+        if (bag.head && bag.epoch + Epoch::kGracePeriods <= e) {
+            freeRetiredChain(bag.head);
+            bag.head = nullptr;
+            bag.count = 0;
+        }
+    }
+    freeRetiredChain(Epoch::adoptOrphans());
+}
+
+/* 到期块按普通 deallocate 回到本地空闲链（大对象 free） */
+void ThreadCache::freeRetiredChain(BlockHeader* head) {
+    while (head) {
+        BlockHeader* next = head->next;
+        deallocate(head + 1);
+        head = next;
+    }
 }
 
 } // namespace mempool
@@ -0,0 +1,159 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib> // std::getenv
+#include <mutex>
+#include <vector>
+
+namespace mempool
+{
+
+namespace
+{
+
+/* 当前输出文件（fileMutex 保护） */
+std::mutex fileMutex;
+std::FILE* traceFile = nullptr;
+
+/* 每次 start 递增；线程缓冲据此丢弃上一轮残留事件 */
+std::atomic<std::uint32_t> traceSession{0};
+
+/* 线程编号分配 */
+std::atomic<std::uint16_t> nextThreadId{0};
+
+struct ThreadBuffer;
+
+/* 所有存活线程缓冲的登记表，stop() 时逐个刷出 */
+std::mutex registryMutex;
+std::vector<ThreadBuffer*> registry;
+
+inline std::uint64_t nowNs() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/* 写出一批事件；未在记录中则直接丢弃 */
+void writeEvents(const std::vector<TraceEvent>& events) {
+    if (events.empty()) return;
+    std::lock_guard<std::mutex> lg(fileMutex);
+    if (traceFile) std::fwrite(events.data(), sizeof(TraceEvent), events.size(), traceFile);
+}
+
+/* 线程缓冲：仅本线程写入，mutex 只在 stop() 跨线程刷出时才会竞争 */
+struct ThreadBuffer {
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    std::uint16_t threadId;
+    std::uint32_t session{0};
+    std::uint64_t nextSeq{0};
+
+    ThreadBuffer() : threadId(nextThreadId.fetch_add(1, std::memory_order_relaxed)) {
+        events.reserve(Trace::kBufferEvents);
+        std::lock_guard<std::mutex> lg(registryMutex);
+        registry.push_back(this);
+    }
+
+    ~ThreadBuffer() {
+        {
+            std::lock_guard<std::mutex> lg(registryMutex);
+            registry.erase(std::find(registry.begin(), registry.end(), this));
+        }
+        std::lock_guard<std::mutex> lg(mutex);
+        flush();
+    }
+
+    /* 持有 mutex 时调用 */
+    void flush() {
+        writeEvents(events);
+        events.clear();
+    }
+
+    void push(TraceOp op, std::uint64_t objectId, std::size_t size) {
+        std::lock_guard<std::mutex> lg(mutex);
+        std::uint32_t cur = traceSession.load(std::memory_order_acquire);
+        if (session != cur) {
+            events.clear(); // 上一轮 stop 之后才写入的残留
+            session = cur;
+        }
+        events.push_back({nowNs(), objectId,
+                          static_cast<std::uint32_t>(std::min<std::size_t>(size, UINT32_MAX)),
+                          threadId, op, 0});
+        if (events.size() >= Trace::kBufferEvents) flush();
+    }
+};
+
+ThreadBuffer& localBuffer() {
+    thread_local ThreadBuffer buf;
+    return buf;
+}
+
+/* 启动时读取 MEMPOOL_TRACE，退出时刷出 */
+struct EnvTrace {
+    EnvTrace() {
+        if (const char* path = std::getenv("MEMPOOL_TRACE"))
+            if (*path && !Trace::start(path)) std::fprintf(stderr, "mempool: cannot trace to %s\n", path);
+    }
+    ~EnvTrace() { Trace::stop(); }
+} envTrace;
+
+} // namespace
+
+bool Trace::start(const char* path) {
+    std::lock_guard<std::mutex> lg(fileMutex);
+    if (traceFile) return false;
+
+    traceFile = std::fopen(path, "wb");
+    if (!traceFile) return false;
+
+    TraceFileHeader hdr{};
+    std::copy(std::begin(kTraceMagic), std::end(kTraceMagic), hdr.magic);
+    hdr.version = kTraceVersion;
+    hdr.eventSize = sizeof(TraceEvent);
+    std::fwrite(&hdr, sizeof(hdr), 1, traceFile);
+
+    traceSession.fetch_add(1, std::memory_order_release);
+    enabled_.store(true, std::memory_order_release);
+    return true;
+}
+
+void Trace::stop() {
+    if (!enabled_.exchange(false, std::memory_order_acq_rel)) return;
+
+    {
+        std::lock_guard<std::mutex> lg(registryMutex);
+        for (ThreadBuffer* buf : registry) {
+            std::lock_guard<std::mutex> bl(buf->mutex);
+            buf->flush();
+        }
+    }
+
+    std::lock_guard<std::mutex> lg(fileMutex);
+    if (traceFile) {
+        std::fclose(traceFile);
+        traceFile = nullptr;
+    }
+}
+
+void Trace::recordAlloc(void* ptr, std::size_t size) noexcept {
+    if (!ptr) return;
+    ThreadBuffer& buf = localBuffer();
+
+    /* 编号 = 标记位 | 线程号 << 40 | 线程内序号；写入闲置的 next 字段 */
+    std::uint64_t id = kTracedBit | (std::uint64_t{buf.threadId} << 40) | (buf.nextSeq++ & ((1ull << 40) - 1));
+    reinterpret_cast<BlockHeader*>(ptr)[-1].next = reinterpret_cast<BlockHeader*>(id);
+
+    buf.push(TraceOp::Alloc, id, size);
+}
+
+void Trace::recordFree(void* ptr) noexcept {
+    if (!ptr) return;
+    auto id = reinterpret_cast<std::uint64_t>(reinterpret_cast<BlockHeader*>(ptr)[-1].next);
+    if (!(id & kTracedBit)) return; // 记录开启前分配的对象
+
+    localBuffer().push(TraceOp::Free, id, 0);
+}
+
+} // namespace mempool
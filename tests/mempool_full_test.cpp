@@ -15,16 +15,30 @@
 #include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <cerrno>
 #include <chrono>
+#include <coroutine>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <initializer_list>
 #include <random>
 #include <thread>
 #include <vector>
 
+#include <sys/mman.h> // mincore
+#include <sys/wait.h> // waitpid
+#include <unistd.h>   // fork
+
+#include "CentralCache.h"
+#include "Coroutine.h"
+#include "Guard.h"
+#include "Heap.h"
 #include "MemoryPool.h"
+#include "Options.h"
 #include "PageCache.h"
+#include "SharedPool.h"
+#include "Trace.h"
 
 using namespace mempool;
 
@@ -60,17 +74,52 @@ void test_span_merge_split() {
 void test_release_threshold() {
     auto& pc = PageCache::getInstance();
     const size_t base = pc.freePages();
-    constexpr size_t big = 2 * PageCache::kReleaseThresholdPages; // 128 MB
+    constexpr size_t big = 2 * Options::kDefaultReleaseThresholdPages; // 128 MB
 
     // 申请 big 页，然后释放，需触发回收
     void* buf = pc.allocateSpan(big);
     pc.freeSpan(buf, big);
 
     // 回收后空闲不应超过阈值
-    assert(pc.freePages() - base <= PageCache::kReleaseThresholdPages);
+    assert(pc.freePages() - base <= Options::kDefaultReleaseThresholdPages);
+    // 归还给系统的页不再属于本 PageCache
+    assert(!pc.owns(buf) && "released system block still in the page map");
     ok("Threshold release");
 }
 
+/* --------------------------------------------------------------- */
+/* 2b. 跨线程归还：span 回到所属分片                               */
+/* --------------------------------------------------------------- */
+void test_shard_cross_thread_free() {
+    auto& pc = PageCache::getInstance();
+    constexpr size_t kSpans = 64;
+
+    std::vector<std::pair<void*, size_t>> spans;
+    std::thread producer([&] {
+        for (size_t i = 0; i < kSpans; ++i) {
+            size_t pages = 1 + i % (2 * PageCache::kFastSpanMaxPages); // 快速槽位 + 锁路径
+            spans.emplace_back(pc.allocateSpan(pages), pages);
+        }
+    });
+    producer.join();
+
+    const size_t base = pc.freePages();
+    size_t freed = 0;
+    std::vector<std::thread> ths;
+    for (int t = 0; t < 4; ++t)
+        ths.emplace_back([&, t] {
+            for (size_t i = t; i < spans.size(); i += 4)
+                pc.freeSpan(spans[i].first, spans[i].second);
+        });
+    for (auto& th : ths)
+        th.join();
+    for (auto& s : spans)
+        freed += s.second;
+
+    assert(pc.freePages() - base == freed && "cross-thread free lost pages");
+    ok("Shard cross-thread free");
+}
+
 /* --------------------------------------------------------------- */
 /* 3. ThreadCache 并发随机尺寸                                     */
 /* --------------------------------------------------------------- */
@@ -102,6 +151,900 @@ void test_threadcache_concurrency() {
     ok("ThreadCache concurrency");
 }
 
+/* --------------------------------------------------------------- */
+/* 3a. 按需切块：大 size-class 也能拿到块，连续分配落在同一 span   */
+/* --------------------------------------------------------------- */
+void test_lazy_carving() {
+    for (size_t sz : {size_t(32 * 1024), size_t(64 * 1024), size_t(200 * 1024), kMaxBytes}) {
+        void* a = MemoryPool::allocate(sz);
+        void* b = MemoryPool::allocate(sz);
+        assert(a && b && "large size-class returned nullptr");
+        std::memset(a, 0x11, sz);
+        std::memset(b, 0x22, sz);
+        MemoryPool::deallocate(a);
+        MemoryPool::deallocate(b);
+    }
+
+    // 冷类：连续分配应从同一未切分区间顺序切出
+    constexpr size_t sz = 5000; // 之前的用例都未触碰过此类
+    void* p = MemoryPool::allocate(sz);
+    void* q = MemoryPool::allocate(sz);
+    assert(static_cast<char*>(q) - static_cast<char*>(p) ==
+               static_cast<ptrdiff_t>(SizeClass::blockBytes(SizeClass::getIndex(sz))) &&
+           "fresh span not carved sequentially");
+    MemoryPool::deallocate(p);
+    MemoryPool::deallocate(q);
+    ok("Lazy span carving");
+}
+
+/* --------------------------------------------------------------- */
+/* 3a'. span 着色：相继 span 的切块起点在尾部余量内错开            */
+/* --------------------------------------------------------------- */
+void test_span_coloring() {
+    auto& cc = CentralCache::getInstance();
+    const size_t index = SizeClass::getIndex(6000); // 之前的用例都未触碰过此类
+    const size_t blk = SizeClass::blockBytes(index);
+    const size_t spanBytes = Options::spanPages() * kPageSize; // 6016 B 块：默认 8 页 span，余量 2688 B
+
+    // 每次取走整个 span：回收链与未切分区间都空，下一次必然换新 span
+    std::vector<BlockBatch> batches;
+    std::vector<size_t> offsets;
+    for (int i = 0; i < 4; ++i) {
+        BlockBatch b = cc.fetchBatch(index, Options::kMaxBatch);
+        assert(!b.list && b.bumpBegin && "expected a fresh span");
+        size_t off = reinterpret_cast<uintptr_t>(b.bumpBegin) % kPageSize;
+        const size_t carved = static_cast<size_t>(b.bumpEnd - b.bumpBegin);
+        assert(off % 64 == 0 && off + carved <= spanBytes && carved == spanBytes / blk * blk &&
+               "color offset outside tail slack");
+        (void)carved;
+        offsets.push_back(off);
+        batches.push_back(b);
+    }
+    std::sort(offsets.begin(), offsets.end());
+    assert(std::unique(offsets.begin(), offsets.end()) == offsets.end() && "spans not colored");
+
+    // 关闭着色：从页首切块
+    Options::set("central.coloring", 0);
+    BlockBatch plain = cc.fetchBatch(index, Options::kMaxBatch);
+    assert(reinterpret_cast<uintptr_t>(plain.bumpBegin) % kPageSize == 0);
+    batches.push_back(plain);
+    Options::set("central.coloring", 1);
+
+    // 全部归还，span 可被 sweep 交回
+    for (auto& b : batches) {
+        BlockHeader* list = nullptr;
+        size_t n = 0;
+        for (char* p = b.bumpBegin; p != b.bumpEnd; p += blk) {
+            auto* hd = reinterpret_cast<BlockHeader*>(p);
+            hd->size = SizeClass::userBytes(index);
+            hd->next = list;
+            list = hd;
+            ++n;
+        }
+        cc.returnBatch(list, n, index);
+    }
+    ok("Span coloring");
+}
+
+/* --------------------------------------------------------------- */
+/* 3a''. 预热：reserve / prewarm 之后的分配不再向 PageCache 要页     */
+/* --------------------------------------------------------------- */
+void test_prewarm() {
+    PageCache& pc = PageCache::getInstance();
+
+    // 只预热 CentralCache：另一线程随后分配 count 块不触发 refill
+    constexpr size_t szA = 3000, cntA = 300; // 跨多个 span，触发旧区间挂链
+    const bool reserved = MemoryPool::reserve(szA, cntA);
+    assert(reserved && "reserve failed");
+    size_t sys0 = pc.systemPages(), free0 = pc.freePages();
+    std::thread([&] {
+        std::vector<void*> v;
+        for (size_t i = 0; i < cntA; ++i) {
+            v.push_back(MemoryPool::allocate(szA));
+            std::memset(v.back(), 0x3C, szA);
+        }
+        assert(pc.systemPages() == sys0 && pc.freePages() == free0 && "reserved class refilled");
+        for (void* p : v)
+            MemoryPool::deallocate(p);
+    }).join();
+
+    // prewarm + 填充本线程 ThreadCache
+    PrewarmProfile prof;
+    prof.classes = {{12000, 50}, {40, 1000}};
+    prof.fillThreadCache = true;
+    std::thread([&] {
+        const bool warmed = MemoryPool::prewarm(prof);
+        assert(warmed && "prewarm failed");
+        size_t sys1 = pc.systemPages(), free1 = pc.freePages();
+        std::vector<void*> v;
+        for (const auto& e : prof.classes)
+            for (size_t i = 0; i < e.count; ++i) {
+                v.push_back(MemoryPool::allocate(e.size));
+                std::memset(v.back(), 0x4D, e.size);
+            }
+        assert(pc.systemPages() == sys1 && pc.freePages() == free1 && "prewarmed class refilled");
+        for (void* p : v)
+            MemoryPool::deallocate(p);
+    }).join();
+
+    const bool largeReserved = MemoryPool::reserve(kMaxBytes + 1, 1);
+    assert(!largeReserved && "large objects cannot be reserved");
+    ok("Prewarm / reserve");
+}
+
+/* --------------------------------------------------------------- */
+/* 3a'''. 运行期参数：读写 / 解析 / 批量、字节预算、回收阈值生效    */
+/* --------------------------------------------------------------- */
+void test_runtime_options() {
+    size_t v = 0;
+    bool found = MemoryPool::getOption("tcache.list_factor", v);
+    assert(found && v == 16);
+    const bool setUnknown = MemoryPool::setOption("no.such.option", 1);
+    const bool getUnknown = MemoryPool::getOption("no.such.option", v);
+    assert(!setUnknown && !getUnknown);
+    const bool zeroSpan = MemoryPool::setOption("central.span_pages", 0);
+    assert(!zeroSpan && "zero span size accepted");
+    const bool batchZero = MemoryPool::setOption("tcache.batch.0", 4);
+    const bool batchHuge = MemoryPool::setOption("tcache.batch.999999", 4);
+    assert(!batchZero && !batchHuge);
+    const size_t applied = Options::parse("tcache.list_factor=8,bogus=1,central.span_pages=x");
+    assert(applied == 1);
+    found = MemoryPool::getOption("tcache.list_factor", v);
+    assert(found && v == 8);
+    MemoryPool::setOption("tcache.list_factor", 16);
+
+    // 批量覆盖：每次补货只取 2 块 → 冷线程分配 6 块需要 3 次中央加锁
+    constexpr size_t szB = 7000;
+    const size_t idxB = SizeClass::getIndex(szB);
+    const bool batchSet = MemoryPool::setOption("tcache.batch.7000", 2);
+    assert(batchSet);
+    found = MemoryPool::getOption("tcache.batch.6999", v);
+    assert(found && v == 2 && "batch not per size-class");
+    std::thread([&] {
+        auto& cc = CentralCache::getInstance();
+        uint64_t before = cc.lockStats(idxB).acquisitions;
+        void* p[6];
+        for (auto& x : p)
+            x = MemoryPool::allocate(szB);
+        assert(cc.lockStats(idxB).acquisitions - before == 3 && "batch override ignored");
+        for (auto& x : p)
+            MemoryPool::deallocate(x);
+    }).join();
+    MemoryPool::setOption("tcache.batch.7000", 0);
+
+    // 字节预算：64 KB 预算下释放 1000 个 1 KB 块必然多次归还 CentralCache
+    constexpr size_t szC = 1024;
+    const size_t idxC = SizeClass::getIndex(szC);
+    MemoryPool::setOption("tcache.max_bytes", 64 * 1024);
+    std::thread([&] {
+        auto& cc = CentralCache::getInstance();
+        std::vector<void*> v;
+        for (int i = 0; i < 1000; ++i)
+            v.push_back(MemoryPool::allocate(szC));
+        uint64_t before = cc.lockStats(idxC).acquisitions;
+        for (void* p : v)
+            MemoryPool::deallocate(p);
+        assert(cc.lockStats(idxC).acquisitions - before > 1 && "byte budget ignored");
+    }).join();
+    MemoryPool::setOption("tcache.max_bytes", 0);
+
+    // 已经热起来的线程：上限副本已缓存，运行中调低预算后下一次释放即按新值归还
+    std::atomic<int> phase{0};
+    std::thread warm([&] {
+        auto& cc = CentralCache::getInstance();
+        std::vector<void*> v;
+        for (int i = 0; i < 1000; ++i)
+            v.push_back(MemoryPool::allocate(szC));
+        for (int i = 0; i < 500; ++i)
+            MemoryPool::deallocate(v[i]);
+        phase.store(1);
+        while (phase.load() != 2)
+            std::this_thread::yield();
+        uint64_t before = cc.lockStats(idxC).acquisitions;
+        for (int i = 500; i < 1000; ++i)
+            MemoryPool::deallocate(v[i]);
+        assert(cc.lockStats(idxC).acquisitions - before > 1 && "option change not seen by warm thread");
+    });
+    while (phase.load() != 1)
+        std::this_thread::yield();
+    MemoryPool::setOption("tcache.max_bytes", 64 * 1024);
+    phase.store(2);
+    warm.join();
+    MemoryPool::setOption("tcache.max_bytes", 0);
+
+    // 回收阈值：调低后大 span 归还即交还系统
+    auto& pc = PageCache::getInstance();
+    MemoryPool::setOption("page.release_threshold", 1024);
+    const size_t base = pc.freePages();
+    void* buf = pc.allocateSpan(8192);
+    pc.freeSpan(buf, 8192);
+    assert(pc.freePages() <= base + 1024 && "release threshold ignored"); // 原有的超标空闲页也会一并归还，可能低于 base
+    MemoryPool::setOption("page.release_threshold", Options::kDefaultReleaseThresholdPages);
+
+    ok("Runtime options");
+}
+
+/* --------------------------------------------------------------- */
+/* 3a''''. 独立堆：互不共享页、析构整体归还、槽位复用后缓存作废     */
+/* --------------------------------------------------------------- */
+void test_heap_instances() {
+    auto& pc = PageCache::getInstance();
+    const size_t sys0 = pc.systemPages();
+
+    void* probe = nullptr;
+    void* bigProbe = nullptr;
+    {
+        Heap h;
+        std::vector<void*> v;
+        for (int i = 0; i < 20000; ++i) {
+            v.push_back(h.allocate(16 + (i % 512) * 8));
+            std::memset(v.back(), 0x7E, 16);
+        }
+        bigProbe = h.allocate(kMaxBytes + 1); // 大对象也来自本堆
+        assert(h.owns(v[0]) && h.owns(bigProbe) && "heap does not own its objects");
+
+        // 其它线程也可以使用同一个堆，并归还本线程分配的对象
+        std::thread([&] {
+            for (int i = 0; i < 10000; ++i)
+                h.deallocate(v[i]);
+            void* q = h.allocate(64);
+            assert(h.owns(q));
+            h.deallocate(q);
+        }).join();
+        for (size_t i = 10000; i < v.size(); ++i)
+            h.deallocate(v[i]);
+
+        assert(pc.systemPages() == sys0 && "heap allocated from the default PageCache");
+        void* dflt = MemoryPool::allocate(64);
+        assert(!h.owns(dflt) && "default heap pointer owned by Heap");
+        MemoryPool::deallocate(dflt);
+        probe = v[0];
+    } // 析构：整段 munmap
+
+    // 已解除映射的页 mincore 返回 ENOMEM
+    unsigned char vec;
+    auto pageOf = [](void* p) {
+        return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(p) & ~(kPageSize - 1));
+    };
+    assert(mincore(pageOf(probe), kPageSize, &vec) == -1 && errno == ENOMEM && "heap pages still mapped");
+    assert(mincore(pageOf(bigProbe), kPageSize, &vec) == -1 && errno == ENOMEM && "large pages still mapped");
+
+    // 新堆复用槽位：本线程旧缓存必须作废，分配结果属于新堆
+    Heap h2;
+    void* r = h2.allocate(16);
+    assert(h2.owns(r) && "stale thread cache reused across heaps");
+    h2.deallocate(r);
+
+    // 线程退出时本堆仍存活：该线程缓存的块交还本堆，全空的 span 回到本堆 PageCache
+    const size_t heapFree = h2.freePages();
+    std::thread([&] {
+        std::vector<void*> w;
+        for (int i = 0; i < 2000; ++i)
+            w.push_back(h2.allocate(256));
+        for (void* p : w)
+            h2.deallocate(p); // 都留在本线程缓存中（未超过链长上限）
+    }).join();
+    assert(h2.freePages() > heapFree && "thread-exit cache not returned to the heap");
+    ok("Heap instances");
+}
+
+/* --------------------------------------------------------------- */
+/* 3a'''''. 内存上限：主动回收 / 软上限 / 硬上限先回收后 OOM 回调   */
+/* --------------------------------------------------------------- */
+static std::atomic<int> oomCalls{0};
+static bool countingOomHandler(size_t) {
+    oomCalls.fetch_add(1);
+    return false;
+}
+
+void test_memory_limits() {
+    auto& pc = PageCache::getInstance();
+    constexpr size_t MB = 1 << 20;
+    auto held = [&] { return pc.systemPages() * kPageSize; };
+    auto fill = [](std::vector<void*>& v, size_t sz, size_t bytes) {
+        for (size_t b = 0; b < bytes; b += sz) {
+            v.push_back(MemoryPool::allocate(sz));
+            std::memset(v.back(), 0x6B, sz);
+        }
+    };
+    auto drain = [](std::vector<void*>& v) {
+        for (void* p : v)
+            MemoryPool::deallocate(p);
+        v.clear();
+    };
+    std::vector<void*> v;
+
+    // releaseMemory：全部释放后的空 span 交还系统
+    fill(v, 2000, 48 * MB);
+    drain(v);
+    const size_t peak = held();
+    MemoryPool::releaseMemory();
+    assert(peak - held() >= 40 * MB && "releaseMemory did not return empty spans");
+
+    // 软上限：越线时主动回收一次
+    uint64_t epoch0 = CentralCache::trimEpoch();
+    MemoryPool::setOption("limit.soft_bytes", held() + 4 * MB);
+    fill(v, 2500, 8 * MB);
+    assert(CentralCache::trimEpoch() > epoch0 && "soft limit did not trigger reclaim");
+    drain(v);
+    MemoryPool::setOption("limit.soft_bytes", 0);
+
+    // 硬上限：缓存里闲置的内存先被回收，不必惊动 OOM 处理器
+    MemoryPool::setOomHandler(countingOomHandler);
+    fill(v, 3000, 16 * MB);
+    drain(v);
+    MemoryPool::setOption("limit.hard_bytes", held() + MB);
+    fill(v, 5000, 8 * MB);
+    assert(oomCalls.load() == 0 && "reclaim should have satisfied the hard limit");
+    drain(v);
+
+    // 硬上限：回收也不够时调用处理器，处理器放弃则抛出 bad_alloc
+    MemoryPool::setOption("limit.hard_bytes", held() + 16 * MB);
+    bool threw = false;
+    try {
+        fill(v, 100 * 1024, 64 * MB);
+    } catch (const std::bad_alloc&) {
+        threw = true;
+    }
+    assert(threw && oomCalls.load() >= 1 && "hard limit not enforced");
+    drain(v);
+    MemoryPool::setOption("limit.hard_bytes", 0);
+    MemoryPool::setOomHandler(nullptr);
+
+    // 失败路径不能泄漏 size-class 锁
+    void* p = MemoryPool::allocate(100 * 1024);
+    MemoryPool::deallocate(p);
+    ok("Memory limits");
+}
+
+/* --------------------------------------------------------------- */
+/* 3a'. 清零分配：回收块 / 新块 / 大块 / mmap 新页都必须全零        */
+/* --------------------------------------------------------------- */
+static bool all_zero(const void* p, size_t n) {
+    const unsigned char* c = static_cast<const unsigned char*>(p);
+    for (size_t i = 0; i < n; ++i)
+        if (c[i]) return false;
+    return true;
+}
+
+void test_allocate_zeroed() {
+    const size_t sizes[] = {8, 24, 100, 4096, 70 * 1024, 200 * 1024, kMaxBytes + 1};
+
+    // 先弄脏再归还，使下一次分配拿到回收块
+    for (size_t sz : sizes) {
+        std::vector<void*> v;
+        for (int i = 0; i < 8; ++i) {
+            v.push_back(MemoryPool::allocate(sz));
+            std::memset(v.back(), 0xFF, sz);
+        }
+        for (void* p : v)
+            MemoryPool::deallocate(p);
+        for (int i = 0; i < 16; ++i) { // 前 8 个是回收块，之后来自未切分区间
+            v.push_back(MemoryPool::allocate_zeroed(sz));
+            assert(all_zero(v.back(), sz) && "allocate_zeroed returned dirty memory");
+        }
+        for (size_t i = 8; i < v.size(); ++i)
+            MemoryPool::deallocate(v[i]);
+    }
+
+    // calloc 语义与溢出检测
+    auto* arr = static_cast<int*>(MemoryPool::calloc(1000, sizeof(int)));
+    assert(all_zero(arr, 1000 * sizeof(int)));
+    MemoryPool::deallocate(arr);
+    bool threw = false;
+    try {
+        MemoryPool::calloc(SIZE_MAX / 2, 4);
+    } catch (const std::bad_alloc&) {
+        threw = true;
+    }
+    assert(threw && "calloc overflow not detected");
+
+    // PageCache：新页已知全零；大 span 归还时 MADV_DONTNEED 后仍是全零
+    auto& pc = PageCache::getInstance();
+    constexpr size_t pages = 2 * PageCache::kDontNeedMinPages;
+    bool zeroed = false;
+    void* span = pc.allocateSpan(pages, &zeroed);
+    assert(zeroed && all_zero(span, pages * kPageSize));
+    std::memset(span, 0xCC, pages * kPageSize);
+    pc.freeSpan(span, pages);
+    void* again = pc.allocateSpan(pages, &zeroed);
+    assert(!zeroed || all_zero(again, pages * kPageSize));
+    pc.freeSpan(again, pages);
+
+    ok("Zeroed allocation");
+}
+
+/* --------------------------------------------------------------- */
+/* 3b. CentralCache 锁竞争统计                                     */
+/* --------------------------------------------------------------- */
+void test_central_lock_stats() {
+    auto& cc = CentralCache::getInstance();
+    constexpr size_t index = 7; // 64 B
+    constexpr int T = 4;
+    constexpr size_t N = 20'000;
+    const LockStats before = cc.lockStats(index);
+
+    // 每次 fetch / return 恰好各加锁一次
+    std::vector<std::thread> ths;
+    for (int t = 0; t < T; ++t)
+        ths.emplace_back([&] {
+            for (size_t i = 0; i < N; ++i) {
+                BlockBatch b = cc.fetchBatch(index, 4);
+                // 未切分部分补写头部后与回收链一起归还
+                BlockHeader* list = b.list;
+                size_t n = b.listCount;
+                for (char* p = b.bumpBegin; p != b.bumpEnd; p += SizeClass::blockBytes(index)) {
+                    auto* hd = reinterpret_cast<BlockHeader*>(p);
+                    hd->size = SizeClass::userBytes(index);
+                    hd->next = list;
+                    list = hd;
+                    ++n;
+                }
+                cc.returnBatch(list, n, index);
+            }
+        });
+    for (auto& th : ths)
+        th.join();
+
+    const LockStats after = cc.lockStats(index);
+    assert(after.acquisitions - before.acquisitions == 2 * T * N && "lock acquisitions miscounted");
+    assert(after.contended - before.contended <= after.acquisitions - before.acquisitions);
+    assert(after.parks - before.parks <= after.contended - before.contended);
+    ok("CentralCache lock stats");
+}
+
+/* --------------------------------------------------------------- */
+/* 3c. 纪元延迟回收：读者离开前退休块不回到空闲链                    */
+/* --------------------------------------------------------------- */
+void test_epoch_retire() {
+    // 块回到本地链表头即可断言复用：只要求此类在本线程与孤儿表中没有其它待回收的退休块
+    constexpr size_t sz = 7000;
+
+    // 无读者：collectRetired 推进两格后立即回收，块回到本地链表头
+    void* p = MemoryPool::allocate(sz);
+    MemoryPool::retire(p);
+    void* q = MemoryPool::allocate(sz);
+    assert(q != p && "retired block reused before grace period");
+    size_t pending = MemoryPool::collectRetired();
+    assert(pending == 0);
+    void* again = MemoryPool::allocate(sz);
+    assert(again == p && "expired block not returned to the free list");
+    MemoryPool::deallocate(again);
+    MemoryPool::deallocate(q);
+
+    // 另一线程停在临界区：退休块必须等它离开
+    std::atomic<int> stage{0};
+    std::thread reader([&] {
+        MemoryPool::EpochGuard g;
+        stage.store(1);
+        while (stage.load() != 2)
+            std::this_thread::yield();
+    });
+    while (stage.load() != 1)
+        std::this_thread::yield();
+    void* r = MemoryPool::allocate(sz);
+    MemoryPool::retire(r);
+    pending = MemoryPool::collectRetired();
+    assert(pending == 1 && "retired block freed under a pinned reader");
+    void* other = MemoryPool::allocate(sz);
+    assert(other != r);
+    stage.store(2);
+    reader.join();
+    pending = MemoryPool::collectRetired();
+    assert(pending == 0);
+    again = MemoryPool::allocate(sz);
+    assert(again == r);
+    MemoryPool::deallocate(again);
+    MemoryPool::deallocate(other);
+
+    // 并发：写者不断替换共享节点并退休旧节点，读者在临界区内读到的节点内容不变
+    struct Node {
+        uint64_t value;
+        uint64_t check;
+    };
+    std::atomic<Node*> cur{new (MemoryPool::allocate(sizeof(Node))) Node{0, ~0ull}};
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; ++t)
+        readers.emplace_back([&] {
+            while (!stop.load(std::memory_order_relaxed)) {
+                MemoryPool::EpochGuard g;
+                Node* n = cur.load(std::memory_order_acquire);
+                uint64_t v = n->value;
+                for (int i = 0; i < 16; ++i)
+                    std::atomic_signal_fence(std::memory_order_seq_cst);
+                assert(n->value == v && n->check == ~v && "node reused while pinned");
+                (void)v;
+            }
+        });
+    for (uint64_t i = 1; i <= 200'000; ++i) {
+        Node* n = new (MemoryPool::allocate(sizeof(Node))) Node{i, ~i};
+        MemoryPool::retire(cur.exchange(n, std::memory_order_acq_rel));
+    }
+    stop.store(true);
+    for (auto& th : readers)
+        th.join();
+    MemoryPool::retire(cur.load());
+    pending = MemoryPool::collectRetired();
+    assert(pending == 0);
+
+    // ThreadCache 析构之后（更晚的 TLS 析构函数中）：EpochGuard 为空操作，退休块直接进孤儿表，
+    // 到期后由其它线程回收（3000 B 类只有这里退休，孤儿表中的该类块即为 late.p）
+    struct LateRetire {
+        void* p{nullptr};
+        ~LateRetire() {
+            MemoryPool::EpochGuard g;
+            MemoryPool::retire(p);
+        }
+    };
+    void* orphaned = nullptr;
+    std::thread([&] {
+        thread_local LateRetire late; // 先于 ThreadCache 构造，晚于它析构
+        late.p = orphaned = MemoryPool::allocate(3000);
+    }).join();
+    pending = MemoryPool::collectRetired();
+    assert(pending == 0);
+    again = MemoryPool::allocate(3000);
+    assert(again == orphaned && "block retired after thread teardown not collected");
+    MemoryPool::deallocate(again);
+    (void)pending;
+    ok("Epoch retire");
+}
+
+/* --------------------------------------------------------------- */
+/* 3d. 跨进程共享池：子进程读取并释放父进程分配的消息；重新 attach  */
+/* --------------------------------------------------------------- */
+void test_shared_pool() {
+    char path[64];
+    std::snprintf(path, sizeof(path), "/tmp/mempool_shared_test_%d", (int)getpid());
+    ::unlink(path);
+
+    // 由内核选址：默认固定基址可能落在 sanitizer 的保留区
+    auto pool = SharedPool::create(path, 64 << 20, nullptr);
+    assert(pool && "cannot create shared pool");
+    assert(!SharedPool::create(path, 64 << 20, nullptr) && "create must not clobber an existing region");
+
+    // 父进程：1 MB 消息（按页）+ 小对象索引，根偏移指向索引
+    constexpr size_t kMsg = 1 << 20;
+    auto* msg = static_cast<unsigned char*>(pool->allocate(kMsg));
+    for (size_t i = 0; i < kMsg; ++i)
+        msg[i] = static_cast<unsigned char>(i * 7);
+    auto* index = static_cast<uint64_t*>(pool->allocate(sizeof(uint64_t)));
+    *index = pool->offsetOf(msg);
+    pool->setRoot(pool->offsetOf(index));
+    const size_t freeBefore = pool->freeBytes();
+
+    // 子进程：校验消息、跨进程释放、写回复
+    pid_t pid = fork();
+    if (pid == 0) {
+        auto* idx = static_cast<uint64_t*>(pool->at(pool->root()));
+        auto* m = static_cast<unsigned char*>(pool->at(*idx));
+        for (size_t i = 0; i < kMsg; ++i)
+            if (m[i] != static_cast<unsigned char>(i * 7)) _exit(1);
+        pool->deallocate(m);
+        pool->deallocate(idx);
+        auto* reply = static_cast<char*>(pool->allocate(256));
+        std::strcpy(reply, "ack");
+        pool->setRoot(pool->offsetOf(reply));
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0 && "child failed to read the message");
+    assert(!std::strcmp(static_cast<char*>(pool->at(pool->root())), "ack"));
+    // 消息的页回到空闲链，回复所在的 size-class 从中切走一个 8 页 span
+    assert(pool->freeBytes() + 8 * kPageSize >= freeBefore + kMsg && "cross-process free lost pages");
+
+    // 同一基址已被映射：attach 必须失败而不是映射到别处
+    assert(!SharedPool::attach(path) && errno == EEXIST);
+
+    // 热恢复：解除映射后重新 attach，数据与根偏移都在
+    void* base = pool->base();
+    pool.reset();
+    pool = SharedPool::attach(path);
+    assert(pool && pool->base() == base && "reattach failed");
+    assert(!std::strcmp(static_cast<char*>(pool->at(pool->root())), "ack"));
+    pool->deallocate(pool->at(pool->root()));
+
+    // 页区合并：A B C D 依次释放 A、C、B 后合并为一段，3 倍大小的申请正好复用 A 的位置
+    const size_t freeAll = pool->freeBytes();
+    constexpr size_t kBig = 300 * 1024;
+    void* blk[4];
+    for (auto& b : blk)
+        b = pool->allocate(kBig);
+    pool->deallocate(blk[0]);
+    pool->deallocate(blk[2]);
+    pool->deallocate(blk[1]);
+    void* merged = pool->allocate(3 * kBig);
+    assert(merged == blk[0] && "adjacent free spans not coalesced");
+    pool->deallocate(merged);
+    pool->deallocate(blk[3]); // 与 top 相接：全部退回 top
+    assert(pool->freeBytes() == freeAll);
+
+    pool.reset();
+    ::unlink(path);
+
+    // memfd：经 fd 重新 attach
+    auto anon = SharedPool::create(nullptr, 16 << 20, nullptr);
+    assert(anon);
+    void* p = anon->allocate(100);
+    anon->setRoot(anon->offsetOf(p));
+    int fd = dup(anon->fd());
+    anon.reset();
+    anon = SharedPool::attach(fd);
+    close(fd);
+    assert(anon && anon->at(anon->root()) == p);
+    anon->deallocate(p);
+    ok("Shared pool");
+}
+
+/* --------------------------------------------------------------- */
+/* 3e. 分配标签：按标签计数、作用域嵌套、跨线程释放、软预算        */
+/* --------------------------------------------------------------- */
+static std::atomic<int> budgetHits{0};
+static void onTagBudget(Tags::Tag tag, int64_t live) {
+    assert(tag == 11 && live > 64 * 1024);
+    (void)tag;
+    (void)live;
+    budgetHits.fetch_add(1);
+}
+
+void test_allocation_tags() {
+    const int64_t blk100 = SizeClass::userBytes(SizeClass::getIndex(100));
+
+    // 显式标签
+    std::vector<void*> tagged;
+    for (int i = 0; i < 10; ++i)
+        tagged.push_back(MemoryPool::allocate(100, 7));
+    void* big = MemoryPool::allocate(300 * 1024, 7);
+    TagStats s = MemoryPool::tagStats(7);
+    assert(s.liveBytes == 10 * blk100 + 300 * 1024 && s.allocCount == 11);
+
+    // 大对象释放后扣减；小块回到空闲链时已剥离标签
+    MemoryPool::deallocate(big);
+    void* last = tagged.back();
+    tagged.pop_back();
+    MemoryPool::deallocate(last);
+    void* reused = MemoryPool::allocate(100);
+    assert(reused == last && reinterpret_cast<BlockHeader*>(reused)[-1].size == size_t(blk100) &&
+           "tag not stripped on free");
+    MemoryPool::deallocate(reused);
+    assert(MemoryPool::tagStats(7).liveBytes == 9 * blk100);
+
+    // 另一线程释放（线程退出后计数并入全局累计）
+    std::thread([&] {
+        for (void* p : tagged)
+            MemoryPool::deallocate(p);
+    }).join();
+    s = MemoryPool::tagStats(7);
+    assert(s.liveBytes == 0 && s.freeCount == 11);
+
+    // 本线程计数析构之后（更晚的 TLS 析构函数中）释放：直接计入全局累计
+    struct LateFree {
+        void* p{nullptr};
+        ~LateFree() { MemoryPool::deallocate(p); }
+    };
+    std::thread([] {
+        MemoryPool::deallocate(MemoryPool::allocate(64)); // ThreadCache 先构造、最后析构
+        thread_local LateFree late;
+        late.p = MemoryPool::allocate(100, 13); // 首次打标签才构造本线程计数，最先析构
+    }).join();
+    s = MemoryPool::tagStats(13);
+    assert(s.liveBytes == 0 && s.freeCount == 1 && "free after thread tags destroyed lost");
+
+    // 作用域：嵌套与恢复
+    void *a, *b, *c;
+    {
+        MemoryPool::TagScope outer(9);
+        a = MemoryPool::allocate(64);
+        {
+            MemoryPool::TagScope inner(10);
+            b = MemoryPool::allocate_zeroed(64);
+        }
+        c = MemoryPool::allocate(64);
+    }
+    void* plain = MemoryPool::allocate(64);
+    assert(MemoryPool::tagStats(9).allocCount == 2 && MemoryPool::tagStats(10).allocCount == 1);
+    assert(reinterpret_cast<BlockHeader*>(plain)[-1].size == 64 && "allocation outside scope tagged");
+    for (void* p : {a, b, c, plain})
+        MemoryPool::deallocate(p);
+    assert(MemoryPool::tagStats(9).liveBytes == 0 && MemoryPool::tagStats(10).liveBytes == 0);
+
+    // 软预算：越线回调一次，不拒绝分配
+    auto oldHandler = MemoryPool::setTagBudgetHandler(onTagBudget);
+    MemoryPool::setTagBudget(11, 64 * 1024);
+    std::vector<void*> burst;
+    {
+        MemoryPool::TagScope scope(11);
+        for (uint32_t i = 0; i < 2 * Tags::kBudgetCheckInterval; ++i)
+            burst.push_back(MemoryPool::allocate(1024));
+    }
+    assert(budgetHits.load() == 1 && "budget handler not called exactly once");
+    for (void* p : burst)
+        MemoryPool::deallocate(p);
+    MemoryPool::setTagBudget(11, 0);
+    MemoryPool::setTagBudgetHandler(oldHandler);
+    ok("Allocation tags");
+}
+
+/* --------------------------------------------------------------- */
+/* 3f. 协程帧：pooled_promise 经 FrameCache 分配，同尺寸帧被复用    */
+/* --------------------------------------------------------------- */
+struct PooledTask {
+    struct promise_type : pooled_promise {
+        int value{0};
+        PooledTask get_return_object() {
+            return PooledTask{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_value(int v) { value = v; }
+        void unhandled_exception() { std::terminate(); }
+    };
+    std::coroutine_handle<promise_type> h;
+};
+
+PooledTask add_one(int x) { co_return x + 1; }
+
+void test_coroutine_frames() {
+    PooledTask t = add_one(1);
+    void* frame = t.h.address();
+    t.h.resume();
+    assert(t.h.done() && t.h.promise().value == 2);
+    t.h.destroy();
+
+    // 同一协程函数的帧大小相同：下一帧直接取回刚释放的那块
+    PooledTask u = add_one(5);
+    assert(u.h.address() == frame && "coroutine frame not recycled");
+    u.h.resume();
+    assert(u.h.promise().value == 6);
+
+    // 另一线程创建、本线程销毁
+    PooledTask v{};
+    std::thread([&] { v = add_one(10); }).join();
+    v.h.resume();
+    assert(v.h.promise().value == 11);
+    v.h.destroy();
+    u.h.destroy();
+
+    // 本线程 FrameCache 析构之后（更晚的 TLS 析构函数中）销毁的帧直接交回 MemoryPool
+    struct LateFrame {
+        std::coroutine_handle<> h;
+        ~LateFrame() { h.destroy(); }
+    };
+    std::thread([] {
+        MemoryPool::deallocate(MemoryPool::allocate(64)); // ThreadCache 先构造、最后析构
+        thread_local LateFrame late;
+        late.h = add_one(20).h; // 首个帧才构造 FrameCache，最先析构
+    }).join();
+    ok("Coroutine frames");
+}
+
+/* --------------------------------------------------------------- */
+/* 3g. 守护页采样：块尾紧贴守护页，越界 / 释放后使用在子进程中报告  */
+/* --------------------------------------------------------------- */
+/* 采样率为 1 时，本线程的计数器至多再倒数 kDisabledInterval 次就会落到守护槽位上 */
+static void* guardedAllocate(size_t size) {
+    for (;;) {
+        void* p = MemoryPool::allocate(size);
+        if (Guard::owns(p)) return p;
+        MemoryPool::deallocate(p);
+    }
+}
+
+/* 子进程执行 body（应触发守护页故障）：子进程须异常终止，且 stderr 中含有 expect 各项 */
+static bool guardFaultReported(void (*body)(), std::initializer_list<const char*> expect) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[0]);
+        body();
+        _exit(0);
+    }
+    close(fds[1]);
+    char buf[16384];
+    size_t n = 0;
+    ssize_t r;
+    char sink[4096];
+    while ((r = read(fds[0], n + 1 < sizeof(buf) ? buf + n : sink,
+                     n + 1 < sizeof(buf) ? sizeof(buf) - 1 - n : sizeof(sink))) > 0)
+        if (n + 1 < sizeof(buf)) n += size_t(r);
+    buf[n] = '\0';
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) return false;
+    for (const char* e : expect)
+        if (!std::strstr(buf, e)) return false;
+    return true;
+}
+
+void test_guard_pages() {
+    MemoryPool::setOption("guard.sample_rate", 1);
+    const size_t blk = SizeClass::roundUp(100);
+
+    // 块尾紧贴守护页，块内可正常读写
+    void* p = guardedAllocate(100);
+    assert((reinterpret_cast<uintptr_t>(p) + blk) % kPageSize == 0 && "guarded block not flush with guard page");
+    std::memset(p, 0xab, 100);
+    GuardStats s = Guard::stats();
+    assert(s.slots == 256 && s.live == 1 && s.sampled >= 1);
+
+    // 之后每次分配都取样：带标签、清零分配同样适用
+    void* t = MemoryPool::allocate(100, 12);
+    int64_t tagged = MemoryPool::tagStats(12).liveBytes;
+    assert(Guard::owns(t) && tagged == int64_t(blk));
+    MemoryPool::deallocate(t);
+    tagged = MemoryPool::tagStats(12).liveBytes;
+    assert(tagged == 0);
+    (void)tagged;
+
+    auto* z = static_cast<unsigned char*>(MemoryPool::allocate_zeroed(200));
+    assert(Guard::owns(z));
+    for (int i = 0; i < 200; ++i)
+        assert(z[i] == 0);
+
+    // 放不进一页的请求、独立堆都不采样
+    void* big = MemoryPool::allocate(5000);
+    assert(!Guard::owns(big));
+    {
+        Heap heap;
+        void* hp = heap.allocate(64);
+        assert(!Guard::owns(hp));
+        heap.deallocate(hp);
+    }
+
+    // 隔离：刚释放的槽位最后才复用
+    MemoryPool::deallocate(p);
+    void* q = MemoryPool::allocate(100);
+    assert(Guard::owns(q) && q != p && "freed guard slot reused immediately");
+
+    // 槽位用尽：退回普通分配
+    std::vector<void*> hold;
+    for (size_t i = 0; i < s.slots; ++i)
+        hold.push_back(MemoryPool::allocate(32));
+    s = Guard::stats();
+    assert(!Guard::owns(hold.back()) && s.exhausted >= 1);
+    for (void* h : hold)
+        MemoryPool::deallocate(h);
+    for (void* h : {q, big, static_cast<void*>(z)})
+        MemoryPool::deallocate(h);
+    s = Guard::stats();
+    assert(s.live == 0);
+
+    // 故障报告：类型 + 分配 / 释放调用栈
+    bool reported = guardFaultReported(
+        [] {
+            auto* x = static_cast<volatile char*>(guardedAllocate(32));
+            MemoryPool::deallocate(const_cast<char*>(x));
+            (void)x[0];
+        },
+        {"use-after-free", "allocated by thread", "freed by thread"});
+    assert(reported && "use-after-free not reported");
+    reported = guardFaultReported(
+        [] {
+            auto* x = static_cast<volatile char*>(guardedAllocate(24));
+            x[24] = 1;
+        },
+        {"buffer-overflow", "0 bytes after the 24-byte block", "allocated by thread"});
+    assert(reported && "buffer overflow not reported");
+    reported = guardFaultReported(
+        [] {
+            void* x = guardedAllocate(48);
+            MemoryPool::deallocate(x);
+            MemoryPool::deallocate(x);
+        },
+        {"double-free", "freed by thread"});
+    assert(reported && "double free not reported");
+    (void)reported;
+
+    MemoryPool::setOption("guard.sample_rate", 0);
+    ok("Guard pages");
+}
+
 /* --------------------------------------------------------------- */
 /* 4. 线程退出回收                                                 */
 /* --------------------------------------------------------------- */
@@ -118,9 +1061,73 @@ void test_thread_exit_cleanup() {
     }
     // allow a tiny leak margin (if any)
     assert(pc.freePages() >= before && "leak on thread exit");
+
+    // ThreadCache 析构之后（更晚的 TLS 析构函数中）的释放 / 分配直接找 CentralCache：
+    // 块回到中央回收链表头，而不是留在已析构的缓存里
+    constexpr size_t sz = 2600;
+    const size_t index = SizeClass::getIndex(sz);
+    static void* lateBlock = nullptr;
+    static void* lateReused = nullptr;
+    struct LateFree {
+        ~LateFree() {
+            MemoryPool::deallocate(lateBlock);
+            lateReused = MemoryPool::allocate(sz);
+            MemoryPool::deallocate(lateReused);
+        }
+    };
+    std::thread([] {
+        thread_local LateFree late; // 先于 ThreadCache 构造，晚于它析构
+        (void)late;
+        lateBlock = MemoryPool::allocate(sz);
+    }).join();
+    auto& cc = CentralCache::getInstance();
+    BlockBatch b = cc.fetchBatch(index, 1);
+    assert(lateReused == lateBlock && b.list + 1 == lateBlock && "late free not returned to CentralCache");
+    cc.returnBatch(b.list, b.listCount, index);
     ok("Thread exit cleanup");
 }
 
+/* --------------------------------------------------------------- */
+/* 4b. 轨迹记录：跨线程释放也能按对象编号配对                      */
+/* --------------------------------------------------------------- */
+void test_trace_record() {
+    const char* path = "mempool_trace_test.bin";
+    void* before = MemoryPool::allocate(32); // 记录开启前分配，释放时不应出现在轨迹中
+
+    bool started = MemoryPool::startTrace(path);
+    assert(started && "cannot open trace file");
+
+    constexpr int N = 10'000; // 超过单线程缓冲，覆盖中途刷出
+    std::vector<void*> handoff(N);
+    for (int i = 0; i < N; ++i)
+        handoff[i] = MemoryPool::allocate(16 + i % 512);
+    std::thread consumer([&] {
+        for (void* p : handoff)
+            MemoryPool::deallocate(p);
+    });
+    consumer.join();
+    MemoryPool::deallocate(before);
+    MemoryPool::stopTrace();
+
+    FILE* f = std::fopen(path, "rb");
+    assert(f);
+    TraceFileHeader hdr{};
+    size_t got = std::fread(&hdr, sizeof(hdr), 1, f);
+    assert(got == 1 && std::memcmp(hdr.magic, kTraceMagic, 8) == 0);
+
+    std::vector<uint64_t> allocIds, freeIds;
+    TraceEvent ev;
+    while (std::fread(&ev, sizeof(ev), 1, f) == 1)
+        (ev.op == TraceOp::Alloc ? allocIds : freeIds).push_back(ev.objectId);
+    std::fclose(f);
+    std::remove(path);
+
+    std::sort(allocIds.begin(), allocIds.end());
+    std::sort(freeIds.begin(), freeIds.end());
+    assert(allocIds.size() == N && allocIds == freeIds && "trace alloc/free ids do not pair up");
+    ok("Trace record");
+}
+
 /* --------------------------------------------------------------- */
 /* 5. 随机长跑                                                      */
 /* --------------------------------------------------------------- */
@@ -153,8 +1160,23 @@ void test_random_longrun() {
 int main() {
     test_span_merge_split();
     test_release_threshold();
+    test_shard_cross_thread_free();
     test_threadcache_concurrency();
+    test_lazy_carving();
+    test_span_coloring();
+    test_prewarm();
+    test_runtime_options();
+    test_heap_instances();
+    test_memory_limits();
+    test_allocate_zeroed();
+    test_central_lock_stats();
+    test_epoch_retire();
+    test_shared_pool();
+    test_allocation_tags();
+    test_coroutine_frames();
+    test_guard_pages();
     test_thread_exit_cleanup();
+    test_trace_record();
     test_random_longrun();
 
     std::puts("All extended tests passed!");
@@ -0,0 +1,289 @@
+/******************************************************************
+ * mempool_replay.cpp
+ *
+ * 回放 MemoryPool 记录的分配轨迹（MEMPOOL_TRACE / MemoryPool::startTrace）
+ *  - 保留原始线程结构：每个记录线程对应一个回放线程，按原顺序执行
+ *  - 跨线程释放：等待分配方线程把指针发布后再释放（原轨迹中分配必然早于释放）
+ *  - 每个分配器在独立子进程中回放，峰值 RSS 互不干扰
+ *  - 报告：吞吐（ops/s）、峰值 RSS 增量、碎片率（峰值 RSS 增量 / 峰值存活字节）
+ *
+ * 用法：mempool_replay <trace> [--alloc mempool|malloc|new]... [--lib path[:malloc:free]]
+ *                               [--dump-sizes file]
+ *   不指定 --alloc 时回放 mempool 与 malloc；--lib 通过 dlopen 载入任意分配器；
+ *   --dump-sizes 输出“size weight”尺寸分布，可直接给 perf_latency --sizes 使用。
+ ******************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <dlfcn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "MemoryPool.h"
+#include "Trace.h"
+
+using namespace mempool;
+using clk = std::chrono::steady_clock;
+
+// ────────────────────────────────────────────────────────────
+// 轨迹加载
+// ────────────────────────────────────────────────────────────
+struct ReplayOp {
+    std::uint32_t slot; // 对象槽位
+    std::uint32_t size; // 分配大小（释放时不用；allocate(0) 记录的大小就是 0）
+    TraceOp op;
+};
+
+struct Workload {
+    std::vector<std::vector<ReplayOp>> threads; // 每个原始线程的操作序列
+    std::vector<std::uint32_t> slotSize;        // 槽位 → 分配大小
+    std::size_t ops{0};
+    std::size_t peakLiveBytes{0};
+};
+
+static bool load_trace(const char* path, Workload& w) {
+    FILE* f = std::fopen(path, "rb");
+    if (!f) return false;
+
+    TraceFileHeader hdr{};
+    if (std::fread(&hdr, sizeof(hdr), 1, f) != 1 || std::memcmp(hdr.magic, kTraceMagic, 8) != 0 ||
+        hdr.version != kTraceVersion || hdr.eventSize != sizeof(TraceEvent)) {
+        std::fclose(f);
+        return false;
+    }
+
+    std::vector<TraceEvent> ev;
+    TraceEvent buf[4096];
+    std::size_t n;
+    while ((n = std::fread(buf, sizeof(TraceEvent), 4096, f)) > 0)
+        ev.insert(ev.end(), buf, buf + n);
+    std::fclose(f);
+
+    /* 全局按时间排序（同一线程内稳定），既用于分配槽位，也用于计算峰值存活字节 */
+    std::stable_sort(ev.begin(), ev.end(),
+                     [](const TraceEvent& a, const TraceEvent& b) { return a.timestampNs < b.timestampNs; });
+
+    std::unordered_map<std::uint64_t, std::uint32_t> slotOf;
+    std::map<std::uint16_t, std::size_t> threadIndex;
+    std::size_t live = 0;
+
+    for (const auto& e : ev) {
+        std::uint32_t slot;
+        if (e.op == TraceOp::Alloc) {
+            slot = static_cast<std::uint32_t>(w.slotSize.size());
+            slotOf.emplace(e.objectId, slot);
+            w.slotSize.push_back(e.size);
+            live += e.size;
+            w.peakLiveBytes = std::max(w.peakLiveBytes, live);
+        } else {
+            auto it = slotOf.find(e.objectId);
+            if (it == slotOf.end()) continue; // 轨迹开始前分配的对象
+            slot = it->second;
+            slotOf.erase(it);
+            live -= w.slotSize[slot];
+        }
+
+        auto [ti, fresh] = threadIndex.emplace(e.threadId, w.threads.size());
+        if (fresh) w.threads.emplace_back();
+        w.threads[ti->second].push_back({slot, e.size, e.op});
+        ++w.ops;
+    }
+    return true;
+}
+
+static void dump_sizes(const Workload& w, const char* path) {
+    std::map<std::uint32_t, std::size_t> hist;
+    for (std::uint32_t s : w.slotSize)
+        ++hist[s];
+    FILE* f = std::fopen(path, "w");
+    if (!f) return;
+    std::fprintf(f, "# size weight\n");
+    for (auto& [size, cnt] : hist)
+        std::fprintf(f, "%u %zu\n", size, cnt);
+    std::fclose(f);
+}
+
+// ────────────────────────────────────────────────────────────
+// 分配器
+// ────────────────────────────────────────────────────────────
+struct Allocator {
+    std::string name;
+    void* (*alloc)(std::size_t);
+    void (*free)(void*);
+};
+
+static void* palloc(std::size_t n) { return MemoryPool::allocate(n); }
+static void pfree(void* p) { MemoryPool::deallocate(p); }
+static void* nalloc(std::size_t n) { return ::operator new(n); }
+static void nfree(void* p) { ::operator delete(p); }
+
+/* --lib path[:mallocSym:freeSym] */
+static bool load_lib(const std::string& spec, Allocator& out) {
+    std::string path = spec, mallocSym = "malloc", freeSym = "free";
+    if (auto c1 = spec.find(':'); c1 != std::string::npos) {
+        path = spec.substr(0, c1);
+        auto c2 = spec.find(':', c1 + 1);
+        mallocSym = spec.substr(c1 + 1, c2 - c1 - 1);
+        if (c2 != std::string::npos) freeSym = spec.substr(c2 + 1);
+    }
+    void* h = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!h) return false;
+    out.alloc = reinterpret_cast<void* (*)(std::size_t)>(dlsym(h, mallocSym.c_str()));
+    out.free = reinterpret_cast<void (*)(void*)>(dlsym(h, freeSym.c_str()));
+    out.name = path.substr(path.find_last_of('/') + 1);
+    return out.alloc && out.free;
+}
+
+// ────────────────────────────────────────────────────────────
+// 回放
+// ────────────────────────────────────────────────────────────
+struct Result {
+    double ms;
+    long startRssKb;
+    long peakRssKb;
+};
+
+static long rss_kb() {
+    long pages = 0, resident = 0;
+    if (FILE* f = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        std::fclose(f);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static long hwm_kb() {
+    long kb = 0;
+    if (FILE* f = std::fopen("/proc/self/status", "r")) {
+        char line[256];
+        while (std::fgets(line, sizeof(line), f))
+            if (std::sscanf(line, "VmHWM: %ld kB", &kb) == 1) break;
+        std::fclose(f);
+    }
+    return kb;
+}
+
+static Result replay(const Workload& w, const Allocator& a) {
+    std::vector<std::atomic<void*>> slots(w.slotSize.size());
+    Result r{};
+    r.startRssKb = rss_kb();
+
+    const int thr = static_cast<int>(w.threads.size());
+    std::atomic<int> ready{0};
+    std::vector<std::thread> threads;
+    auto t0 = clk::now();
+    for (int t = 0; t < thr; ++t) {
+        threads.emplace_back([&, t] {
+            ready.fetch_add(1);
+            while (ready.load() < thr)
+                std::this_thread::yield();
+            for (const ReplayOp& op : w.threads[t]) {
+                if (op.op == TraceOp::Alloc) {
+                    slots[op.slot].store(a.alloc(op.size), std::memory_order_release);
+                } else {
+                    void* p;
+                    while (!(p = slots[op.slot].load(std::memory_order_acquire)))
+                        std::this_thread::yield(); // 等待其它线程完成分配
+                    a.free(p);
+                    slots[op.slot].store(nullptr, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+    for (auto& th : threads)
+        th.join();
+    r.ms = std::chrono::duration<double, std::milli>(clk::now() - t0).count();
+    r.peakRssKb = hwm_kb();
+
+    /* 轨迹结束时仍存活的对象 */
+    for (auto& s : slots)
+        if (void* p = s.load(std::memory_order_relaxed)) a.free(p);
+    return r;
+}
+
+/* 在子进程中回放，结果经管道带回 */
+static bool replay_isolated(const Workload& w, const Allocator& a, Result& out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        Result r = replay(w, a);
+        ssize_t wr = write(fds[1], &r, sizeof(r));
+        _exit(wr == sizeof(r) ? 0 : 1);
+    }
+    close(fds[1]);
+    bool ok = read(fds[0], &out, sizeof(out)) == sizeof(out);
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr,
+                     "usage: %s <trace> [--alloc mempool|malloc|new]... [--lib path[:malloc:free]] "
+                     "[--dump-sizes file]\n",
+                     argv[0]);
+        return 2;
+    }
+
+    std::vector<Allocator> allocators;
+    const char* dumpPath = nullptr;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string opt = argv[i], val = argv[i + 1];
+        if (opt == "--alloc") {
+            if (val == "mempool")
+                allocators.push_back({"MemoryPool", palloc, pfree});
+            else if (val == "malloc")
+                allocators.push_back({"glibc", std::malloc, std::free});
+            else if (val == "new")
+                allocators.push_back({"NewDelete", nalloc, nfree});
+        } else if (opt == "--lib") {
+            Allocator a;
+            if (load_lib(val, a))
+                allocators.push_back(a);
+            else
+                std::fprintf(stderr, "cannot load allocator %s\n", val.c_str());
+        } else if (opt == "--dump-sizes") {
+            dumpPath = argv[i + 1];
+        }
+    }
+    if (allocators.empty()) {
+        allocators.push_back({"MemoryPool", palloc, pfree});
+        allocators.push_back({"glibc", std::malloc, std::free});
+    }
+
+    Workload w;
+    if (!load_trace(argv[1], w)) {
+        std::fprintf(stderr, "cannot read trace %s\n", argv[1]);
+        return 1;
+    }
+    if (dumpPath) dump_sizes(w, dumpPath);
+
+    printf("===== Trace replay: %zu ops, %zu threads, peak live %.1f MB =====\n\n", w.ops, w.threads.size(),
+           w.peakLiveBytes / 1048576.0);
+    printf("%-12s %10s %12s %14s %8s\n", "allocator", "ms", "Mops/s", "peak RSS (MB)", "frag");
+    for (const auto& a : allocators) {
+        Result r;
+        if (!replay_isolated(w, a, r)) {
+            printf("%-12s failed\n", a.name.c_str());
+            continue;
+        }
+        double peakMb = (r.peakRssKb - r.startRssKb) / 1024.0;
+        double frag = w.peakLiveBytes ? (r.peakRssKb - r.startRssKb) * 1024.0 / w.peakLiveBytes : 0.0;
+        printf("%-12s %10.2f %12.2f %14.1f %8.2f\n", a.name.c_str(), r.ms, w.ops / r.ms / 1000.0, peakMb, frag);
+    }
+    return 0;
+}
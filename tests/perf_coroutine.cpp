@@ -0,0 +1,175 @@
+/******************************************************************
+ * perf_coroutine.cpp
+ *
+ * 协程帧分配基准：创建并销毁协程链，对比三种帧分配方式
+ *  - new/delete    : 默认的全局 operator new / delete
+ *  - MemoryPool    : promise_type 的 operator new / delete 直接调用 MemoryPool
+ *  - pooled_promise: 经 FrameCache 按帧大小回收（mempool::pooled_promise）
+ *  场景：
+ *  - chain  : 深度 D 的 co_await 链（每层一个帧），逐条创建 / 运行 / 销毁
+ *  - fanout : 同时存活 W 个协程，全部运行后再全部销毁（超出帧缓存容量）
+ *  输出：每个帧的 ns（创建 + 运行 + 销毁），多线程时为各线程墙钟时间 / 每线程帧数
+ *
+ * 用法：perf_coroutine [--depth D] [--chains N] [--width W] [--threads T]
+ ******************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Coroutine.h"
+#include "MemoryPool.h"
+
+using namespace mempool;
+using clk = std::chrono::steady_clock;
+
+/* 帧分配方式：作为 promise_type 的基类 */
+struct DefaultFrames {};
+
+struct PoolFrames {
+    static void* operator new(std::size_t size) { return MemoryPool::allocate(size); }
+    static void operator delete(void* ptr, std::size_t) noexcept { MemoryPool::deallocate(ptr); }
+};
+
+/* 可 co_await 的任务：初始挂起，结束时对称转移回等待者 */
+template <typename Frames>
+struct Task {
+    struct promise_type : Frames {
+        long value{0};
+        std::coroutine_handle<> cont;
+
+        Task get_return_object() { return Task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct Final {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                auto c = h.promise().cont;
+                return c ? c : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        Final final_suspend() noexcept { return {}; }
+
+        void return_value(long v) { value = v; }
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    explicit Task(std::coroutine_handle<promise_type> h) : h_(h) {}
+    Task(Task&& o) noexcept : h_(std::exchange(o.h_, {})) {}
+    Task& operator=(Task&&) = delete;
+    ~Task() {
+        if (h_) h_.destroy();
+    }
+
+    bool await_ready() noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> c) noexcept {
+        h_.promise().cont = c;
+        return h_;
+    }
+    long await_resume() noexcept { return h_.promise().value; }
+
+    /* 顶层驱动：运行到结束并取结果 */
+    long run() {
+        h_.resume();
+        return h_.promise().value;
+    }
+
+private:
+    std::coroutine_handle<promise_type> h_;
+};
+
+template <typename Frames>
+Task<Frames> chain(int depth) {
+    if (depth == 0) co_return 1;
+    long v = co_await chain<Frames>(depth - 1);
+    co_return v + 1;
+}
+
+template <typename Frames>
+Task<Frames> leaf(long x) {
+    co_return x * 2;
+}
+
+struct Config {
+    int depth = 8;
+    std::size_t chains = 1'000'000;
+    std::size_t width = 4096;
+    int threads = 1;
+};
+
+/* 在 threads 个线程上各跑一遍 body，返回墙钟时间 / 每线程帧数（ns） */
+template <typename Body>
+static double measure(int threads, std::size_t framesPerThread, Body body) {
+    std::atomic<int> ready{0};
+    std::vector<std::thread> ths;
+    auto t0 = clk::now();
+    for (int i = 0; i < threads; ++i)
+        ths.emplace_back([&] {
+            ready.fetch_add(1);
+            while (ready.load() < threads)
+                std::this_thread::yield();
+            body();
+        });
+    for (auto& t : ths)
+        t.join();
+    double ns = std::chrono::duration<double, std::nano>(clk::now() - t0).count();
+    return ns / double(framesPerThread);
+}
+
+static std::atomic<long> sink{0};
+
+template <typename Frames>
+static void run_all(const char* name, const Config& cfg) {
+    /* chain：每条链 depth + 1 个帧 */
+    double chainNs = measure(cfg.threads, cfg.chains * (cfg.depth + 1), [&] {
+        long sum = 0;
+        for (std::size_t i = 0; i < cfg.chains; ++i)
+            sum += chain<Frames>(cfg.depth).run();
+        sink.fetch_add(sum, std::memory_order_relaxed);
+    });
+
+    /* fanout：width 个帧同时存活 */
+    const std::size_t rounds = std::max<std::size_t>(1, cfg.chains * (cfg.depth + 1) / cfg.width);
+    double fanNs = measure(cfg.threads, rounds * cfg.width, [&] {
+        long sum = 0;
+        std::vector<Task<Frames>> live;
+        live.reserve(cfg.width);
+        for (std::size_t r = 0; r < rounds; ++r) {
+            for (std::size_t i = 0; i < cfg.width; ++i)
+                live.push_back(leaf<Frames>(long(i)));
+            for (auto& t : live)
+                sum += t.run();
+            live.clear();
+        }
+        sink.fetch_add(sum, std::memory_order_relaxed);
+    });
+
+    printf("%-16s %12.2f %12.2f\n", name, chainNs, fanNs);
+}
+
+int main(int argc, char** argv) {
+    Config cfg;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--depth")) cfg.depth = std::max(0, std::atoi(argv[i + 1]));
+        if (!std::strcmp(argv[i], "--chains")) cfg.chains = std::max(1, std::atoi(argv[i + 1]));
+        if (!std::strcmp(argv[i], "--width")) cfg.width = std::max(1, std::atoi(argv[i + 1]));
+        if (!std::strcmp(argv[i], "--threads")) cfg.threads = std::max(1, std::atoi(argv[i + 1]));
+    }
+
+    printf("===== Coroutine frames: depth %d x %zu chains, fan-out width %zu, %d thread(s) =====\n", cfg.depth,
+           cfg.chains, cfg.width, cfg.threads);
+    printf("\n%-16s %12s %12s\n", "frames", "chain ns/fr", "fanout ns/fr");
+
+    run_all<DefaultFrames>("new/delete", cfg);
+    run_all<PoolFrames>("MemoryPool", cfg);
+    run_all<pooled_promise>("pooled_promise", cfg);
+    return sink.load() == 42 ? 1 : 0; // 防止结果被优化掉
+}
@@ -0,0 +1,221 @@
+/******************************************************************
+ * perf_frag.cpp
+ *
+ * 碎片 / RSS 长跑基准：分阶段切换负载，定期采样
+ *      RSS（/proc/self/statm）、程序存活字节、内存池持有字节（PageCache::systemPages）
+ *  阶段：
+ *      burst64   — 大量 64 B 对象
+ *      free64    — 全部释放
+ *      burst4k   — 同样总量的 4 KB 对象（能否复用刚释放的 64 B 内存？）
+ *      free4k    — 全部释放
+ *      churn     — 混合尺寸（16 B..8 KB，对数均匀）随机寿命长跑
+ *      threads   — 一串短命线程各自分配 / 释放后退出
+ *  输出：各阶段结束时的快照、峰值 / 稳态开销比，以及逐次采样的 CSV（--csv）
+ *
+ * 用法：perf_frag [--mb 总量MB] [--csv out.csv]
+ ******************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "MemoryPool.h"
+#include "PageCache.h"
+
+using namespace mempool;
+
+static long page_kb() { return sysconf(_SC_PAGESIZE) / 1024; }
+
+static std::size_t rss_bytes() {
+    long pages = 0, resident = 0;
+    if (FILE* f = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        std::fclose(f);
+    }
+    return std::size_t(resident) * page_kb() * 1024;
+}
+
+static std::size_t held_bytes() { return PageCache::getInstance().systemPages() * kPageSize; }
+
+struct Sample {
+    std::string phase;
+    std::size_t ops;
+    std::size_t live;
+    std::size_t held;
+    std::size_t rss;
+};
+
+class Recorder {
+public:
+    explicit Recorder(std::size_t every) : every_(every), rss0_(rss_bytes()) {}
+
+    /* 每次操作后调用；每 every_ 次采样一次 */
+    void tick(const char* phase, std::size_t live) {
+        if (++ops_ % every_ == 0) sample(phase, live);
+    }
+
+    void sample(const char* phase, std::size_t live) {
+        std::size_t rss = rss_bytes();
+        samples_.push_back({phase, ops_, live, held_bytes(), rss > rss0_ ? rss - rss0_ : 0});
+    }
+
+    const std::vector<Sample>& samples() const { return samples_; }
+
+    void write_csv(const char* path) const {
+        FILE* f = std::fopen(path, "w");
+        if (!f) return;
+        std::fprintf(f, "phase,ops,live_bytes,held_bytes,rss_bytes\n");
+        for (const auto& s : samples_)
+            std::fprintf(f, "%s,%zu,%zu,%zu,%zu\n", s.phase.c_str(), s.ops, s.live, s.held, s.rss);
+        std::fclose(f);
+    }
+
+private:
+    std::size_t every_;
+    std::size_t ops_{0};
+    std::size_t rss0_;
+    std::vector<Sample> samples_;
+};
+
+struct Obj {
+    void* p;
+    std::size_t size;
+};
+
+static void burst(Recorder& rec, const char* phase, std::vector<Obj>& live, std::size_t& liveBytes,
+                  std::size_t objSize, std::size_t volume) {
+    while (liveBytes < volume) {
+        void* p = MemoryPool::allocate(objSize);
+        std::memset(p, 0xA5, objSize); // 真正触碰，RSS 才有意义
+        live.push_back({p, objSize});
+        liveBytes += objSize;
+        rec.tick(phase, liveBytes);
+    }
+    rec.sample(phase, liveBytes);
+}
+
+static void free_all(Recorder& rec, const char* phase, std::vector<Obj>& live, std::size_t& liveBytes) {
+    for (auto& o : live) {
+        MemoryPool::deallocate(o.p);
+        liveBytes -= o.size;
+        rec.tick(phase, liveBytes);
+    }
+    live.clear();
+    rec.sample(phase, liveBytes);
+}
+
+static void churn(Recorder& rec, std::vector<Obj>& live, std::size_t& liveBytes, std::size_t target,
+                  std::size_t ops) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> logSize(std::log(16.0), std::log(8192.0));
+    for (std::size_t i = 0; i < ops; ++i) {
+        bool grow = liveBytes < target / 2 || (liveBytes < target && (rng() & 1));
+        if (grow || live.empty()) {
+            std::size_t sz = std::size_t(std::exp(logSize(rng)));
+            void* p = MemoryPool::allocate(sz);
+            std::memset(p, 0x5A, sz);
+            live.push_back({p, sz});
+            liveBytes += sz;
+        } else {
+            std::size_t idx = rng() % live.size();
+            MemoryPool::deallocate(live[idx].p);
+            liveBytes -= live[idx].size;
+            live[idx] = live.back();
+            live.pop_back();
+        }
+        rec.tick("churn", liveBytes);
+    }
+    rec.sample("churn", liveBytes);
+}
+
+static void thread_churn(Recorder& rec, std::size_t liveBytes, std::size_t perThread, int rounds) {
+    for (int r = 0; r < rounds; ++r) {
+        std::thread([perThread] {
+            std::vector<void*> v;
+            for (std::size_t b = 0; b < perThread; b += 256)
+                v.push_back(MemoryPool::allocate(256));
+            for (void* p : v)
+                MemoryPool::deallocate(p);
+        }).join();
+        rec.sample("threads", liveBytes);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::size_t mb = 128;
+    const char* csvPath = "perf_frag.csv";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--mb"))
+            mb = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--csv"))
+            csvPath = argv[i + 1];
+    }
+    const std::size_t volume = mb << 20;
+
+    Recorder rec(64 * 1024);
+    std::vector<Obj> live;
+    std::size_t liveBytes = 0;
+
+    struct Snap {
+        const char* phase;
+        std::size_t live, held, rss;
+    };
+    std::vector<Snap> snaps;
+    auto snap = [&](const char* phase) {
+        const Sample& s = rec.samples().back();
+        snaps.push_back({phase, s.live, s.held, s.rss});
+    };
+
+    burst(rec, "burst64", live, liveBytes, 64, volume);
+    snap("burst64");
+    free_all(rec, "free64", live, liveBytes);
+    snap("free64");
+
+    const std::size_t heldBefore4k = held_bytes();
+    burst(rec, "burst4k", live, liveBytes, 4096, volume);
+    snap("burst4k");
+    const std::size_t grown4k = held_bytes() - heldBefore4k;
+    free_all(rec, "free4k", live, liveBytes);
+    snap("free4k");
+
+    churn(rec, live, liveBytes, volume / 4, 4'000'000);
+    snap("churn");
+    const double steady = liveBytes ? double(held_bytes()) / double(liveBytes) : 0.0;
+
+    thread_churn(rec, liveBytes, volume / 16, 8);
+    snap("threads");
+
+    free_all(rec, "end", live, liveBytes);
+    snap("end");
+
+    std::size_t peakLive = 0, peakHeld = 0, peakRss = 0;
+    for (const auto& s : rec.samples()) {
+        peakLive = std::max(peakLive, s.live);
+        peakHeld = std::max(peakHeld, s.held);
+        peakRss = std::max(peakRss, s.rss);
+    }
+
+    const double MB = 1048576.0;
+    printf("===== Fragmentation / RSS (%zu MB phases) =====\n\n", mb);
+    printf("%-10s %12s %12s %12s %10s\n", "phase", "live (MB)", "held (MB)", "RSS (MB)", "held/live");
+    for (const auto& s : snaps)
+        printf("%-10s %12.1f %12.1f %12.1f %10.2f\n", s.phase, s.live / MB, s.held / MB, s.rss / MB,
+               s.live ? double(s.held) / double(s.live) : 0.0);
+
+    printf("\nPeak live    : %.1f MB\n", peakLive / MB);
+    printf("Peak held    : %.1f MB (%.2fx live)\n", peakHeld / MB, double(peakHeld) / double(peakLive));
+    printf("Peak RSS     : %.1f MB (%.2fx live)\n", peakRss / MB, double(peakRss) / double(peakLive));
+    printf("Steady churn : %.2fx held/live\n", steady);
+    printf("4 KB reuse   : %.1f%% of freed 64 B memory reused (held grew %.1f MB for %.1f MB live)\n",
+           100.0 * (1.0 - std::min(1.0, double(grown4k) / double(volume))), grown4k / MB, volume / MB);
+
+    if (csvPath) rec.write_csv(csvPath);
+    return 0;
+}
@@ -0,0 +1,407 @@
+/******************************************************************
+ * perf_latency.cpp
+ *
+ * 单次操作延迟基准：MemoryPool vs new/delete
+ *  - 每次 allocate / deallocate 单独计时（x86-64 用 rdtsc，其它平台用 clock_gettime）
+ *  - 结果写入 HDR 风格的对数-线性直方图，输出 p50 / p99 / p99.9 / max
+ *  - 场景：
+ *      batch      — 先分配 N 个再全部释放（大批量触发 Central 补货 / 归还）
+ *      mt_batch   — 多线程同时做 batch（PageCache / CentralCache 竞争）
+ *      lifetime   — 随机寿命：活跃集合中随机挑选对象释放
+ *      prodcons   — 生产者分配、消费者释放（跨线程释放）
+ *  - 尺寸分布：默认内置分布，或 --sizes 指定“size weight”格式的文件（可由 trace 统计得到）
+ *  - 结果可另存为 CSV（--csv）与 JSON（--json），便于跟踪回归
+ *
+ * 用法：perf_latency [--ops N] [--sizes file] [--csv out.csv] [--json out.json]
+ ******************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __x86_64__
+#include <x86intrin.h> // __rdtsc
+#endif
+
+#include "MemoryPool.h"
+
+// ────────────────────────────────────────────────────────────
+// 计时：返回“tick”，再统一换算为纳秒
+// ────────────────────────────────────────────────────────────
+static inline std::uint64_t ticks() noexcept {
+#ifdef __x86_64__
+    return __rdtsc();
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return std::uint64_t(ts.tv_sec) * 1'000'000'000ull + ts.tv_nsec;
+#endif
+}
+
+// 每 tick 对应的纳秒数（rdtsc 需与 steady_clock 校准）
+static double calibrate_ns_per_tick() {
+#ifdef __x86_64__
+    auto t0 = std::chrono::steady_clock::now();
+    std::uint64_t c0 = ticks();
+    while (std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(50))
+        ;
+    std::uint64_t c1 = ticks();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    return ns / double(c1 - c0);
+#else
+    return 1.0;
+#endif
+}
+
+// ────────────────────────────────────────────────────────────
+// HDR 风格直方图：前 128 个值线性，之后每个 2 的幂区间 64 个子桶（≈1.5% 精度）
+// ────────────────────────────────────────────────────────────
+class Histogram {
+public:
+    static constexpr int kSubBits = 6;
+    static constexpr std::uint64_t kSub = 1ull << kSubBits;   // 64
+    static constexpr std::uint64_t kLinear = 2 * kSub;         // 128
+    static constexpr std::size_t kBuckets = kLinear + (64 - kSubBits - 1) * kSub;
+
+    Histogram() : counts_(kBuckets, 0) {}
+
+    void record(std::uint64_t v) noexcept {
+        ++counts_[indexOf(v)];
+        ++total_;
+        if (v > max_) max_ = v;
+    }
+
+    void merge(const Histogram& o) {
+        for (std::size_t i = 0; i < kBuckets; ++i)
+            counts_[i] += o.counts_[i];
+        total_ += o.total_;
+        max_ = std::max(max_, o.max_);
+    }
+
+    std::uint64_t count() const noexcept { return total_; }
+    std::uint64_t max() const noexcept { return max_; }
+
+    /** 百分位（q ∈ [0, 1]），返回所在桶的中点 */
+    std::uint64_t percentile(double q) const noexcept {
+        if (total_ == 0) return 0;
+        std::uint64_t want = std::max<std::uint64_t>(1, std::uint64_t(q * double(total_) + 0.5));
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < kBuckets; ++i) {
+            seen += counts_[i];
+            if (seen >= want) return std::min(midOf(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    static std::size_t indexOf(std::uint64_t v) noexcept {
+        if (v < kLinear) return std::size_t(v);
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - kSubBits;                 // 使 v >> shift ∈ [64, 128)
+        std::uint64_t top = v >> shift;
+        return std::size_t(kLinear + (shift - 1) * kSub + (top - kSub));
+    }
+
+    static std::uint64_t midOf(std::size_t idx) noexcept {
+        if (idx < kLinear) return idx;
+        std::size_t rel = idx - kLinear;
+        int shift = int(rel / kSub) + 1;
+        std::uint64_t top = kSub + rel % kSub;
+        return (top << shift) + (1ull << (shift - 1));
+    }
+
+    std::vector<std::uint64_t> counts_;
+    std::uint64_t total_{0};
+    std::uint64_t max_{0};
+};
+
+// ────────────────────────────────────────────────────────────
+// 尺寸分布：离散 (size, weight) 表
+// ────────────────────────────────────────────────────────────
+struct SizeDist {
+    std::vector<std::size_t> sizes;
+    std::vector<double> weights;
+
+    /* 内置：偏向小对象、带少量中等与大对象的“服务端”分布 */
+    static SizeDist builtin() {
+        return {{16, 32, 48, 64, 96, 128, 256, 512, 1024, 4096, 16384},
+                {18, 22, 12, 14, 8, 8, 6, 5, 4, 2, 1}};
+    }
+
+    /* 文件格式：每行 “size weight” 或 “size,weight”，# 开头为注释 */
+    static bool load(const char* path, SizeDist& out) {
+        FILE* f = std::fopen(path, "r");
+        if (!f) return false;
+        char line[256];
+        while (std::fgets(line, sizeof(line), f)) {
+            if (line[0] == '#') continue;
+            for (char* c = line; *c; ++c)
+                if (*c == ',') *c = ' ';
+            unsigned long long sz = 0;
+            double w = 0;
+            if (std::sscanf(line, "%llu %lf", &sz, &w) == 2 && sz > 0 && w > 0) {
+                out.sizes.push_back(std::size_t(sz));
+                out.weights.push_back(w);
+            }
+        }
+        std::fclose(f);
+        return !out.sizes.empty();
+    }
+};
+
+// 从分布中预先抽样，计时循环里只做数组读取
+static std::vector<std::size_t> sample_sizes(const SizeDist& d, std::size_t n, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::discrete_distribution<std::size_t> pick(d.weights.begin(), d.weights.end());
+    std::vector<std::size_t> out(n);
+    for (auto& s : out)
+        s = d.sizes[pick(rng)];
+    return out;
+}
+
+// ────────────────────────────────────────────────────────────
+// 被测分配器
+// ────────────────────────────────────────────────────────────
+struct Allocator {
+    const char* name;
+    void* (*alloc)(std::size_t);
+    void (*free)(void*);
+};
+
+static void* palloc(std::size_t n) { return mempool::MemoryPool::allocate(n); }
+static void pfree(void* p) { mempool::MemoryPool::deallocate(p); }
+static void* nalloc(std::size_t n) { return ::operator new(n, std::nothrow); }
+static void nfree(void* p) { ::operator delete(p); }
+
+struct OpHist {
+    Histogram alloc;
+    Histogram free;
+};
+
+// 计时一次分配
+static inline void* timed_alloc(const Allocator& a, std::size_t n, Histogram& h) {
+    std::uint64_t t0 = ticks();
+    void* p = a.alloc(n);
+    h.record(ticks() - t0);
+    return p;
+}
+
+// 计时一次释放
+static inline void timed_free(const Allocator& a, void* p, Histogram& h) {
+    std::uint64_t t0 = ticks();
+    a.free(p);
+    h.record(ticks() - t0);
+}
+
+// ────────────────────────────────────────────────────────────
+// 场景
+// ────────────────────────────────────────────────────────────
+// batch：分配 N 个 → 释放 N 个，重复至 ops 次分配
+static void run_batch(const Allocator& a, const std::vector<std::size_t>& sizes, std::size_t ops,
+                      std::size_t N, OpHist& h) {
+    std::vector<void*> live(N);
+    for (std::size_t done = 0; done < ops; done += N) {
+        for (std::size_t i = 0; i < N; ++i)
+            live[i] = timed_alloc(a, sizes[(done + i) % sizes.size()], h.alloc);
+        for (std::size_t i = 0; i < N; ++i)
+            timed_free(a, live[i], h.free);
+    }
+}
+
+// mt_batch：thr 个线程同时做 batch，直方图合并
+static void run_mt_batch(const Allocator& a, const std::vector<std::size_t>& sizes, std::size_t ops,
+                         std::size_t N, int thr, OpHist& h) {
+    std::vector<OpHist> local(thr);
+    std::atomic<int> ready{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thr; ++t) {
+        threads.emplace_back([&, t] {
+            ready.fetch_add(1);
+            while (ready.load() < thr)
+                std::this_thread::yield();
+            run_batch(a, sizes, ops / thr, N, local[t]);
+        });
+    }
+    for (auto& th : threads)
+        th.join();
+    for (auto& l : local) {
+        h.alloc.merge(l.alloc);
+        h.free.merge(l.free);
+    }
+}
+
+// lifetime：维持约 live 个活跃对象，每步随机分配或随机释放一个
+static void run_lifetime(const Allocator& a, const std::vector<std::size_t>& sizes, std::size_t ops,
+                         std::size_t live, OpHist& h) {
+    std::mt19937 rng(7);
+    std::vector<void*> pool;
+    pool.reserve(live * 2);
+    std::size_t allocs = 0;
+    while (allocs < ops) {
+        bool doAlloc = pool.size() < live / 2 || (pool.size() < live * 2 && (rng() & 1));
+        if (doAlloc) {
+            pool.push_back(timed_alloc(a, sizes[allocs % sizes.size()], h.alloc));
+            ++allocs;
+        } else {
+            std::size_t idx = rng() % pool.size();
+            timed_free(a, pool[idx], h.free);
+            pool[idx] = pool.back();
+            pool.pop_back();
+        }
+    }
+    for (void* p : pool)
+        timed_free(a, p, h.free);
+}
+
+// prodcons：单生产者分配，经 SPSC 环形队列交给单消费者释放
+static void run_prodcons(const Allocator& a, const std::vector<std::size_t>& sizes, std::size_t ops,
+                         OpHist& h) {
+    constexpr std::size_t kCap = 4096;
+    std::vector<void*> ring(kCap);
+    std::atomic<std::size_t> head{0}, tail{0};
+
+    std::thread consumer([&] {
+        for (std::size_t i = 0; i < ops; ++i) {
+            std::size_t t = tail.load(std::memory_order_relaxed);
+            while (head.load(std::memory_order_acquire) == t)
+                std::this_thread::yield();
+            void* p = ring[t % kCap];
+            tail.store(t + 1, std::memory_order_release);
+            timed_free(a, p, h.free);
+        }
+    });
+
+    for (std::size_t i = 0; i < ops; ++i) {
+        void* p = timed_alloc(a, sizes[i % sizes.size()], h.alloc);
+        std::size_t hd = head.load(std::memory_order_relaxed);
+        while (hd - tail.load(std::memory_order_acquire) >= kCap)
+            std::this_thread::yield();
+        ring[hd % kCap] = p;
+        head.store(hd + 1, std::memory_order_release);
+    }
+    consumer.join();
+}
+
+// ────────────────────────────────────────────────────────────
+// 输出
+// ────────────────────────────────────────────────────────────
+struct Row {
+    std::string scenario;
+    std::string allocator;
+    std::string op;
+    std::uint64_t count;
+    double p50, p99, p999, max; // ns
+};
+
+static Row make_row(const char* sc, const char* al, const char* op, const Histogram& h, double nsPerTick) {
+    return {sc,
+            al,
+            op,
+            h.count(),
+            h.percentile(0.50) * nsPerTick,
+            h.percentile(0.99) * nsPerTick,
+            h.percentile(0.999) * nsPerTick,
+            h.max() * nsPerTick};
+}
+
+static void write_csv(const char* path, const std::vector<Row>& rows) {
+    FILE* f = std::fopen(path, "w");
+    if (!f) {
+        std::fprintf(stderr, "cannot open %s\n", path);
+        return;
+    }
+    std::fprintf(f, "scenario,allocator,op,count,p50_ns,p99_ns,p999_ns,max_ns\n");
+    for (const auto& r : rows)
+        std::fprintf(f, "%s,%s,%s,%llu,%.1f,%.1f,%.1f,%.1f\n", r.scenario.c_str(), r.allocator.c_str(),
+                     r.op.c_str(), (unsigned long long)r.count, r.p50, r.p99, r.p999, r.max);
+    std::fclose(f);
+}
+
+static void write_json(const char* path, const std::vector<Row>& rows) {
+    FILE* f = std::fopen(path, "w");
+    if (!f) {
+        std::fprintf(stderr, "cannot open %s\n", path);
+        return;
+    }
+    std::fprintf(f, "[\n");
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+        const auto& r = rows[i];
+        std::fprintf(f,
+                     "  {\"scenario\": \"%s\", \"allocator\": \"%s\", \"op\": \"%s\", \"count\": %llu, "
+                     "\"p50_ns\": %.1f, \"p99_ns\": %.1f, \"p999_ns\": %.1f, \"max_ns\": %.1f}%s\n",
+                     r.scenario.c_str(), r.allocator.c_str(), r.op.c_str(), (unsigned long long)r.count,
+                     r.p50, r.p99, r.p999, r.max, i + 1 < rows.size() ? "," : "");
+    }
+    std::fprintf(f, "]\n");
+    std::fclose(f);
+}
+
+int main(int argc, char** argv) {
+    std::size_t ops = 1'000'000;
+    const char* sizesPath = nullptr;
+    const char* csvPath = "perf_latency.csv";
+    const char* jsonPath = nullptr;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--ops"))
+            ops = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--sizes"))
+            sizesPath = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--csv"))
+            csvPath = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--json"))
+            jsonPath = argv[i + 1];
+    }
+
+    SizeDist dist;
+    if (!sizesPath || !SizeDist::load(sizesPath, dist)) {
+        if (sizesPath) std::fprintf(stderr, "cannot load %s, using builtin sizes\n", sizesPath);
+        dist = SizeDist::builtin();
+    }
+    std::vector<std::size_t> sizes = sample_sizes(dist, 1 << 16, 1);
+
+    const double nsPerTick = calibrate_ns_per_tick();
+    const int THR = std::max(2u, std::thread::hardware_concurrency());
+
+    const Allocator allocators[] = {{"MemoryPool", palloc, pfree}, {"NewDelete", nalloc, nfree}};
+
+    // 预热：两边的 TLS / 单例都初始化完毕
+    for (const auto& a : allocators)
+        for (int i = 0; i < 10000; ++i)
+            a.free(a.alloc(sizes[i % sizes.size()]));
+
+    std::vector<Row> rows;
+    for (const auto& a : allocators) {
+        OpHist batch, mt, life, pc;
+        run_batch(a, sizes, ops, 1000, batch);
+        run_mt_batch(a, sizes, ops, 1000, THR, mt);
+        run_lifetime(a, sizes, ops, 10000, life);
+        run_prodcons(a, sizes, ops, pc);
+
+        const std::pair<const char*, OpHist*> scenarios[] = {
+            {"batch", &batch}, {"mt_batch", &mt}, {"lifetime", &life}, {"prodcons", &pc}};
+        for (auto& [name, h] : scenarios) {
+            rows.push_back(make_row(name, a.name, "alloc", h->alloc, nsPerTick));
+            rows.push_back(make_row(name, a.name, "free", h->free, nsPerTick));
+        }
+    }
+
+    printf("===== Per-op latency (ns) =====\n\n");
+    printf("%-10s %-11s %-6s %10s %9s %9s %9s %11s\n", "scenario", "allocator", "op", "count", "p50", "p99",
+           "p99.9", "max");
+    for (const auto& r : rows)
+        printf("%-10s %-11s %-6s %10llu %9.1f %9.1f %9.1f %11.1f\n", r.scenario.c_str(), r.allocator.c_str(),
+               r.op.c_str(), (unsigned long long)r.count, r.p50, r.p99, r.p999, r.max);
+
+    if (csvPath) write_csv(csvPath, rows);
+    if (jsonPath) write_json(jsonPath, rows);
+    return 0;
+}
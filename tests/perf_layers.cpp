@@ -0,0 +1,262 @@
+/******************************************************************
+ * perf_layers.cpp
+ *
+ * 分层微基准：绕过快速路径，单独测量每一层的开销
+ *  - ThreadCache  : 强制未命中（tcache.batch=1 / list_factor=1，每次分配 / 归还都进入中央）
+ *                   与全部命中的对照，1..N 线程
+ *  - CentralCache : 直接 fetchBatch / returnBatch，1..N 线程
+ *  - PageCache    : 碎片化空闲表上的 span 拆分、与两侧邻居合并的归还、
+ *                   releaseIfExcess（整块归还 munmap / 找不到整块时的全表扫描）
+ *  输出：ns/op，以及 perf_event_open 可用时的 cycles/op、instructions/op（仅用户态）
+ *
+ * 用法：perf_layers [--threads N]
+ ******************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "CentralCache.h"
+#include "MemoryPool.h"
+#include "Options.h"
+#include "PageCache.h"
+
+using namespace mempool;
+using clk = std::chrono::steady_clock;
+
+// ────────────────────────────────────────────────────────────
+// 硬件计数器：cycles / instructions，inherit 使之包含随后创建的线程
+// ────────────────────────────────────────────────────────────
+class HwCounters {
+public:
+    HwCounters() : cyc_(open(PERF_COUNT_HW_CPU_CYCLES)), ins_(open(PERF_COUNT_HW_INSTRUCTIONS)) {}
+    ~HwCounters() {
+        if (cyc_ >= 0) close(cyc_);
+        if (ins_ >= 0) close(ins_);
+    }
+
+    bool available() const { return cyc_ >= 0 && ins_ >= 0; }
+
+    void start() {
+        for (int fd : {cyc_, ins_})
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+    }
+
+    void stop(std::uint64_t& cycles, std::uint64_t& instructions) {
+        cycles = read(cyc_);
+        instructions = read(ins_);
+    }
+
+private:
+    static int open(std::uint64_t config) {
+        perf_event_attr a{};
+        a.type = PERF_TYPE_HARDWARE;
+        a.size = sizeof(a);
+        a.config = config;
+        a.disabled = 1;
+        a.inherit = 1;
+        a.exclude_kernel = 1;
+        a.exclude_hv = 1;
+        return static_cast<int>(syscall(__NR_perf_event_open, &a, 0, -1, -1, 0));
+    }
+
+    static std::uint64_t read(int fd) {
+        if (fd < 0) return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        std::uint64_t v = 0;
+        if (::read(fd, &v, sizeof(v)) != sizeof(v)) v = 0;
+        return v;
+    }
+
+    int cyc_;
+    int ins_;
+};
+
+static HwCounters* counters;
+
+/* 运行 body(tid) 于 thr 个线程，返回 ns；计数器覆盖全部线程 */
+template <typename Body>
+static void measure(const char* name, int thr, std::size_t opsPerThread, Body body) {
+    std::atomic<int> ready{0};
+    std::vector<std::thread> threads;
+    counters->start();
+    auto t0 = clk::now();
+    for (int i = 0; i < thr; ++i)
+        threads.emplace_back([&, i] {
+            ready.fetch_add(1);
+            while (ready.load() < thr)
+                std::this_thread::yield();
+            body(i);
+        });
+    for (auto& t : threads)
+        t.join();
+    double ns = std::chrono::duration<double, std::nano>(clk::now() - t0).count();
+    std::uint64_t cyc, ins;
+    counters->stop(cyc, ins);
+
+    /* 多线程时以每线程操作数计：ns/op 为墙钟时间 / 每线程操作数 */
+    double ops = double(opsPerThread);
+    double allOps = ops * thr;
+    if (counters->available())
+        printf("%-34s %4d %10zu %10.1f %10.1f %10.1f\n", name, thr, opsPerThread, ns / ops, cyc / allOps,
+               ins / allOps);
+    else
+        printf("%-34s %4d %10zu %10.1f %10s %10s\n", name, thr, opsPerThread, ns / ops, "n/a", "n/a");
+}
+
+// ────────────────────────────────────────────────────────────
+// ThreadCache：命中 vs 强制未命中
+// ────────────────────────────────────────────────────────────
+static constexpr std::size_t kTcSize = 64;
+static constexpr std::size_t kTcWindow = 64; // 每轮分配后全部释放
+static constexpr std::size_t kTcRounds = 20'000;
+
+static void tc_loop(int) {
+    void* p[kTcWindow];
+    for (std::size_t r = 0; r < kTcRounds; ++r) {
+        for (auto& x : p)
+            x = MemoryPool::allocate(kTcSize);
+        for (auto& x : p)
+            MemoryPool::deallocate(x);
+    }
+}
+
+static void bench_thread_cache(const std::vector<int>& threadCounts) {
+    const std::size_t ops = 2 * kTcWindow * kTcRounds;
+    for (int thr : threadCounts)
+        measure("threadcache hit", thr, ops, tc_loop);
+
+    /* 每次补货只取 1 块、本地链上限 1 块：分配与归还都落到 CentralCache */
+    std::size_t oldFactor = 0;
+    Options::get("tcache.list_factor", oldFactor);
+    Options::set("tcache.batch.64", 1);
+    Options::set("tcache.list_factor", 1);
+    for (int thr : threadCounts)
+        measure("threadcache forced miss", thr, ops, tc_loop);
+    Options::set("tcache.batch.64", 0);
+    Options::set("tcache.list_factor", oldFactor);
+}
+
+// ────────────────────────────────────────────────────────────
+// CentralCache：直接 fetchBatch / returnBatch
+// ────────────────────────────────────────────────────────────
+static void bench_central(const std::vector<int>& threadCounts) {
+    constexpr std::size_t kRounds = 200'000;
+    for (std::size_t batch : {std::size_t(1), std::size_t(32)}) {
+        char name[64];
+        std::snprintf(name, sizeof(name), "central fetch+return batch=%zu", batch);
+        const std::size_t index = SizeClass::getIndex(128);
+        auto& cc = CentralCache::getInstance();
+        for (int thr : threadCounts)
+            measure(name, thr, 2 * kRounds, [&](int) {
+                for (std::size_t r = 0; r < kRounds; ++r) {
+                    BlockBatch b = cc.fetchBatch(index, batch);
+                    /* 未切分部分补写头部后与回收链一起归还 */
+                    BlockHeader* list = b.list;
+                    std::size_t n = b.listCount;
+                    for (char* p = b.bumpBegin; p != b.bumpEnd; p += SizeClass::blockBytes(index)) {
+                        auto* hd = reinterpret_cast<BlockHeader*>(p);
+                        hd->size = SizeClass::userBytes(index);
+                        hd->next = list;
+                        list = hd;
+                        ++n;
+                    }
+                    cc.returnBatch(list, n, index);
+                }
+            });
+    }
+}
+
+// ────────────────────────────────────────────────────────────
+// PageCache：拆分 / 合并 / releaseIfExcess
+// ────────────────────────────────────────────────────────────
+static void bench_page_cache() {
+    auto& pc = PageCache::getInstance();
+    /* 20 页：大于无锁槽位覆盖范围、小于 MADV_DONTNEED 门限，只测空闲表本身 */
+    constexpr std::size_t kPages = 20;
+    constexpr std::size_t kSpans = 4000;
+
+    std::size_t oldThreshold = 0;
+    Options::get("page.release_threshold", oldThreshold);
+    Options::set("page.release_threshold", std::size_t(1) << 40); // 拆分 / 合并期间不归还系统
+
+    /* 从一整块中切出 kSpans 段，隔一段释放一段：空闲表被打成互不相邻的碎片 */
+    void* big = pc.allocateSpan(kSpans * kPages);
+    pc.freeSpan(big, kSpans * kPages);
+    std::vector<void*> spans(kSpans);
+    for (auto& s : spans)
+        s = pc.allocateSpan(kPages);
+    for (std::size_t i = 0; i < kSpans; i += 2)
+        pc.freeSpan(spans[i], kPages);
+
+    /* 拆分：每次从 20 页碎片中切出 17 页（绕过槽位），余下 3 页重新入表 */
+    std::vector<void*> split(kSpans / 2);
+    measure("page split (fragmented map)", 1, split.size(), [&](int) {
+        for (auto& s : split)
+            s = pc.allocateSpan(17);
+    });
+    for (auto& s : split)
+        pc.freeSpan(s, 17);
+
+    /* 合并：归还留下的段，每段与左右两侧空闲段合并 */
+    measure("page free + merge both sides", 1, kSpans / 2, [&](int) {
+        for (std::size_t i = 1; i < kSpans; i += 2)
+            pc.freeSpan(spans[i], kPages);
+    });
+
+    /* releaseIfExcess 找不到整块：空闲表全是大块中的碎片，每次归还都扫描全表 */
+    Options::set("page.release_threshold", 0);
+    big = pc.allocateSpan(kSpans * kPages); // 复用刚合并回来的整块，不再 mmap
+    for (std::size_t i = 0; i < kSpans; ++i)
+        spans[i] = static_cast<char*>(big) + i * kPages * kPageSize;
+    measure("page release scan (no whole block)", 1, kSpans / 2, [&](int) {
+        for (std::size_t i = 0; i < kSpans; i += 2)
+            pc.freeSpan(spans[i], kPages);
+    });
+    for (std::size_t i = 1; i < kSpans; i += 2)
+        pc.freeSpan(spans[i], kPages); // 最后一段补齐后整块 munmap
+
+    /* releaseIfExcess 整块归还：每段都是独立 mmap 的系统块，归还即 munmap */
+    for (auto& s : spans)
+        s = pc.allocateSpan(kPages);
+    measure("page release whole block (munmap)", 1, kSpans, [&](int) {
+        for (auto& s : spans)
+            pc.freeSpan(s, kPages);
+    });
+
+    Options::set("page.release_threshold", oldThreshold);
+}
+
+int main(int argc, char** argv) {
+    int maxThr = std::max(4u, std::thread::hardware_concurrency());
+    for (int i = 1; i + 1 < argc; i += 2)
+        if (!std::strcmp(argv[i], "--threads")) maxThr = std::max(1, std::atoi(argv[i + 1]));
+    std::vector<int> threadCounts;
+    for (int t = 1; t <= maxThr; t *= 2)
+        threadCounts.push_back(t);
+
+    HwCounters hw;
+    counters = &hw;
+
+    printf("===== Per-layer microbenchmarks =====\n");
+    if (!hw.available()) printf("(perf_event_open unavailable: hardware counters shown as n/a)\n");
+    printf("\n%-34s %4s %10s %10s %10s %10s\n", "fixture", "thr", "ops/thr", "ns/op", "cyc/op", "ins/op");
+
+    bench_thread_cache(threadCounts);
+    bench_central(threadCounts);
+    bench_page_cache();
+    return 0;
+}
@@ -0,0 +1,147 @@
+/******************************************************************
+ * perf_prewarm.cpp
+ *
+ * 冷启动基准：进程启动后前 N 个“请求”的延迟，对比是否预热
+ *  - 每个请求分配一组混合尺寸的对象并写满（模拟处理一次请求），
+ *    结束时释放其中一半，其余作为长期存活的状态保留
+ *  - 三种模式各在独立子进程中运行，保证都从全冷状态开始：
+ *      cold      — 不预热
+ *      prewarm   — MemoryPool::prewarm 只预热 CentralCache / PageCache
+ *      prewarm+tc — 同时填充请求线程的 ThreadCache
+ *  - 报告：前 N 个请求的 p50 / p99 / max / 总耗时，以及首个请求的延迟
+ *
+ * 用法：perf_prewarm [--requests N]
+ ******************************************************************/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "MemoryPool.h"
+
+using namespace mempool;
+using clk = std::chrono::steady_clock;
+
+/* 一个请求分配的对象：尺寸与个数 */
+struct Item {
+    std::size_t size;
+    std::size_t count;
+};
+static const Item kRequest[] = {
+    {24, 32}, {64, 16}, {200, 8}, {512, 4}, {1500, 2}, {4096, 2}, {16 * 1024, 1}, {64 * 1024, 1},
+};
+
+enum class Mode { Cold, Prewarm, PrewarmTc };
+
+static constexpr int kMaxRequests = 4096;
+
+struct Result {
+    double setupUs;
+    double latUs[kMaxRequests];
+};
+
+static void run(Mode mode, int requests, Result& r) {
+    auto t0 = clk::now();
+    if (mode != Mode::Cold) {
+        /* 每个请求保留一半对象，前 N 个请求共需 ≈ count * (N / 2 + 1) 块 */
+        PrewarmProfile prof;
+        for (const Item& it : kRequest)
+            prof.classes.push_back({it.size, it.count * (requests / 2 + 1)});
+        prof.fillThreadCache = mode == Mode::PrewarmTc;
+        MemoryPool::prewarm(prof);
+    }
+    r.setupUs = std::chrono::duration<double, std::micro>(clk::now() - t0).count();
+
+    std::vector<void*> kept;
+    std::vector<void*> tmp;
+    for (int q = 0; q < requests; ++q) {
+        auto s = clk::now();
+        for (const Item& it : kRequest)
+            for (std::size_t i = 0; i < it.count; ++i) {
+                void* p = MemoryPool::allocate(it.size);
+                std::memset(p, q, it.size);
+                (i & 1 ? kept : tmp).push_back(p);
+            }
+        for (void* p : tmp)
+            MemoryPool::deallocate(p);
+        tmp.clear();
+        r.latUs[q] = std::chrono::duration<double, std::micro>(clk::now() - s).count();
+    }
+    for (void* p : kept)
+        MemoryPool::deallocate(p);
+}
+
+/* 在子进程中运行，结果经管道带回 */
+static bool run_isolated(Mode mode, int requests, Result& out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        auto* r = new Result{};
+        run(mode, requests, *r);
+        const char* b = reinterpret_cast<const char*>(r);
+        std::size_t left = sizeof(Result);
+        while (left) {
+            ssize_t n = write(fds[1], b, left);
+            if (n <= 0) _exit(1);
+            b += n;
+            left -= static_cast<std::size_t>(n);
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    char* b = reinterpret_cast<char*>(&out);
+    std::size_t left = sizeof(Result);
+    while (left) {
+        ssize_t n = read(fds[0], b, left);
+        if (n <= 0) break;
+        b += n;
+        left -= static_cast<std::size_t>(n);
+    }
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return left == 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static double pct(std::vector<double> v, double p) {
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, static_cast<std::size_t>(p * v.size()))];
+}
+
+int main(int argc, char** argv) {
+    int requests = 256;
+    for (int i = 1; i + 1 < argc; i += 2)
+        if (!std::strcmp(argv[i], "--requests")) requests = std::atoi(argv[i + 1]);
+    requests = std::clamp(requests, 1, kMaxRequests);
+
+    printf("===== First %d requests after start (us) =====\n\n", requests);
+    printf("%-11s %10s %10s %10s %10s %10s %10s\n", "mode", "setup", "first", "p50", "p99", "max", "total");
+
+    const struct {
+        Mode mode;
+        const char* name;
+    } modes[] = {{Mode::Cold, "cold"}, {Mode::Prewarm, "prewarm"}, {Mode::PrewarmTc, "prewarm+tc"}};
+
+    auto* r = new Result;
+    for (const auto& m : modes) {
+        if (!run_isolated(m.mode, requests, *r)) {
+            printf("%-11s failed\n", m.name);
+            continue;
+        }
+        std::vector<double> lat(r->latUs, r->latUs + requests);
+        double total = 0;
+        for (double x : lat)
+            total += x;
+        printf("%-11s %10.1f %10.1f %10.2f %10.2f %10.1f %10.1f\n", m.name, r->setupUs, lat[0], pct(lat, 0.5),
+               pct(lat, 0.99), *std::max_element(lat.begin(), lat.end()), total);
+    }
+    delete r;
+    return 0;
+}
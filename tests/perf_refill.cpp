@@ -0,0 +1,118 @@
+/******************************************************************
+ * perf_refill.cpp
+ *
+ * 冷 size-class 并发补货基准：
+ *  - 多线程同时首次触碰大量不同 size-class，每次都会走
+ *    CentralCache::refillFromPageCache → PageCache::allocateSpan
+ *  - 直接对 PageCache 做多线程 span 申请 / 归还（常用小 span + 大 span 混合）
+ *  - 结束时打印 CentralCache 竞争最激烈的 size-class
+ ******************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "CentralCache.h"
+#include "Common.h"
+#include "MemoryPool.h"
+#include "PageCache.h"
+
+using clk = std::chrono::high_resolution_clock;
+using ms = std::chrono::duration<double, std::milli>;
+
+// 让 thr 个线程同时起跑，返回总耗时
+template <typename Body>
+double run_parallel(int thr, Body body) {
+    std::atomic<int> ready{0};
+    std::vector<std::thread> threads;
+    threads.reserve(thr);
+    auto t0 = clk::now();
+    for (int i = 0; i < thr; ++i) {
+        threads.emplace_back([&, i] {
+            ready.fetch_add(1);
+            while (ready.load() < thr)
+                std::this_thread::yield();
+            body(i);
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+    return ms(clk::now() - t0).count();
+}
+
+// 冷 size-class 补货：classes 个 size-class 按线程交错切分，每个类只触碰一次
+double bench_cold_refill(int thr, std::size_t firstClass, std::size_t classes) {
+    return run_parallel(thr, [&](int tid) {
+        std::vector<void*> keep;
+        keep.reserve(classes / thr + 1);
+        for (std::size_t c = firstClass + tid; c < firstClass + classes; c += thr)
+            keep.push_back(mempool::MemoryPool::allocate((c + 1) * mempool::kAlignment));
+        for (void* p : keep)
+            mempool::MemoryPool::deallocate(p);
+    });
+}
+
+// PageCache 直接申请 / 归还 span：batch 个一组，页数在 1..kFastSpanMaxPages 与大 span 间轮换
+double bench_span_churn(int thr, std::size_t rounds, std::size_t batch) {
+    auto& pc = mempool::PageCache::getInstance();
+    return run_parallel(thr, [&](int tid) {
+        std::vector<std::pair<void*, std::size_t>> spans;
+        spans.reserve(batch);
+        for (std::size_t r = 0; r < rounds; ++r) {
+            for (std::size_t i = 0; i < batch; ++i) {
+                std::size_t pages = (i % 8 == 7) ? 64 : 1 + (i + tid) % mempool::PageCache::kFastSpanMaxPages;
+                spans.emplace_back(pc.allocateSpan(pages), pages);
+            }
+            for (auto& [addr, pages] : spans)
+                pc.freeSpan(addr, pages);
+            spans.clear();
+        }
+    });
+}
+
+int main() {
+    int THR = std::max(4u, std::thread::hardware_concurrency());
+
+    constexpr std::size_t kClasses = 512;     // 8 B .. 4 KB
+    constexpr std::size_t kRounds = 20'000;
+    constexpr std::size_t kBatch = 32;
+
+    printf("===== Cold refill / span churn =====\n\n");
+
+    // —— 冷类补货：单线程取前半，多线程取后半，两者都是首次触碰 ——
+    double st_cold = bench_cold_refill(1, 0, kClasses / 2);
+    double mt_cold = bench_cold_refill(THR, kClasses / 2, kClasses / 2);
+    printf("Cold refill %zu classes:\n", kClasses / 2);
+    printf("1-thread    : %.2f ms\n", st_cold);
+    printf("%d-thread    : %.2f ms\n\n", THR, mt_cold);
+
+    // —— span 申请 / 归还 ——
+    double st_span = bench_span_churn(1, kRounds, kBatch);
+    double mt_span = bench_span_churn(THR, kRounds, kBatch);
+    double ops = 2.0 * kRounds * kBatch;
+    printf("Span alloc/free %zu rounds × %zu spans:\n", kRounds, kBatch);
+    printf("1-thread    : %.2f ms (%.1f ns/op)\n", st_span, st_span * 1e6 / ops);
+    printf("%d-thread    : %.2f ms (%.1f ns/op per thread)\n\n", THR, mt_span, mt_span * 1e6 / ops);
+
+    // —— 热点 size-class：按竞争次数（其次加锁次数）排序 ——
+    auto& cc = mempool::CentralCache::getInstance();
+    std::vector<std::size_t> idx(kClasses);
+    for (std::size_t i = 0; i < kClasses; ++i)
+        idx[i] = i;
+    std::sort(idx.begin(), idx.end(), [&](std::size_t a, std::size_t b) {
+        mempool::LockStats sa = cc.lockStats(a), sb = cc.lockStats(b);
+        return sa.contended != sb.contended ? sa.contended > sb.contended
+                                            : sa.acquisitions > sb.acquisitions;
+    });
+    printf("Hottest CentralCache classes (acq / contended / spin cycles / parks):\n");
+    for (std::size_t i = 0; i < 5; ++i) {
+        mempool::LockStats st = cc.lockStats(idx[i]);
+        printf("%6zuB : %llu / %llu / %llu / %llu\n", (idx[i] + 1) * mempool::kAlignment,
+               (unsigned long long)st.acquisitions, (unsigned long long)st.contended,
+               (unsigned long long)st.spinCycles, (unsigned long long)st.parks);
+    }
+
+    return 0;
+}